@@ -4,7 +4,7 @@
 
  Data acquisition using the Keithley 2000 DMM using GPIB.
 
- Copyright (c) 2004...2025 by Joerg Hau.
+ Copyright (c) 2004...2026 by Joerg Hau.
 
  This program is free software; you can redistribute it and/or modify
  it under the terms of the GNU General Public License version 2 as
@@ -32,29 +32,67 @@
  2017-01-07    refined details, added subroutines (JHa)
  2017-07-25    added missing '\n' in log file (JHa)
  2025-08-11    moved everything to GitHub (JHa)
+ 2026-10-18    timing probes for the acquisition loop (-DPROBE) (JHa)
+ 2026-10-18    latency histograms and timing report at end of run (JHa)
+ 2026-10-18    OpenMetrics file (-M, -I); fixed sampling interval (JHa)
+ 2026-10-18    HTTP endpoint for metrics and latest readings (-H) (JHa)
+ 2026-10-18    GPIB I/O through k2kbus.c, binary trace of it (-X) (JHa)
+ 2026-10-18    replay of a recorded session (-P, -F) (JHa)
+ 2026-10-18    simulated instrument (-S), benchmark results as JSON (-B) (JHa)
+ 2026-10-18    soak test on a virtual clock (-Z) (JHa)
+ 2026-10-18    recovery from bus errors with gap marking (-r) (JHa)
+ 2026-10-18    I/O timeout adapted to observed latency (-o) (JHa)
+ 2026-10-18    watchdog thread for hanging bus transactions (-W) (JHa)
+ 2026-10-18    instrument error queue read upon SRQ, errors logged (JHa)
+ 2026-10-18    warm attach: no *rst if the instrument is set up already (-k) (JHa)
+ 2026-10-18    gnuplot started first, and as given by -g; time to first sample (JHa)
+ 2026-10-18    list the instruments on the bus (-L) (JHa)
+ 2026-10-18    model table; burst acquisition where the model can (JHa)
+ 2026-10-18    daemon mode, controlled through a UNIX socket (-D) (JHa)
+ 2026-10-18    bus shared with other programs through k2kbroker (-b) (JHa)
+ 2026-10-18    interval, mode and display changed while running (JHa)
+ 2026-10-18    acquisition plans: steps run one after the other (-p) (JHa)
 
  This should compile with any C compiler, something like:
 
- gcc -Wall -O2 -lgpib k2000.c -o k2000 
+ gcc -Wall -O2 -pthread k2000.c k2kbus.c k2ktrace.c k2kreplay.c k2ksim.c k2kclock.c \
+     k2kdog.c k2khist.c k2kmetrics.c k2khttp.c k2kctl.c k2kclient.c -lgpib -lm -o k2000
+
+ Add -DNO_GPIB (and leave out -lgpib) to build without linux-gpib, e.g.
+ for benchmarks against the simulated instrument (-S) on any machine.
+
+ Add -DPROBE to see where the time goes in the acquisition loop (see
+ probe_report() below).
 
  Make sure the user accessing GPIB devices is in group 'gpib'.
 
 */
 
-#define VERSION "V20170725"	/* String! */
+#define VERSION "V20261018"	/* String! */
 
 //#define DEBUG  /* diagnostic mode, for development only */
+//#define PROBE  /* per-phase timing of the acquisition loop, or use -DPROBE */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <math.h>       /* fabs() */
+#include <ctype.h>      /* tolower() */
 #include <errno.h>      /* command line reading */
 #include <unistd.h>
 #include <termios.h>    /* kbhit() */
 #include <sys/io.h>
 #include <sys/time.h>   /* clock timing */
-#include "gpib/ib.h"
+#include <sys/resource.h>   /* getrusage() */
+#include "k2kbus.h"     /* includes gpib/ib.h */
+#include "k2ktrace.h"
+#include "k2kclock.h"
+#include "k2kdog.h"
+#include "k2khist.h"
+#include "k2kmetrics.h"
+#include "k2khttp.h"
+#include "k2kctl.h"
 
 #define MAXLEN  127      /* text buffers etc */
 #define ESC     27
@@ -62,6 +100,7 @@
 
 #define ERR_FILE  4         /* error code */
 #define ERR_INST  5         /* error code */
+#define ERR_SOAK  6         /* error code */
 
 /* --- stuff for reading the command line --- */
 
@@ -87,16 +126,168 @@ int     readch(void);
 /* --- miscellaneous function prototypes ---- */
 
 int     inst_write (const int dvm, const char *cmd);
+int     inst_setup (const int dvm);
+int     inst_attach (const int dvm);
+int     inst_change (const int dvm, int mode, int display, int burst);
+int     inst_check (const int dvm);
+int     inst_list (void);
+const struct model *model_find (const char *idn);
+int     plan_load (const char *name);
+void    step_text (char *buf, int len, int k);
+int     burst_len (const struct model *m, int dt, int mode);
+int     inst_recover (int *dvm, FILE *outfile, double t0, const char *what);
+int     inst_errors (const int dvm, FILE *outfile, double t0);
 double  timeinfo (void);
 int     strclean (char *buf);
 int     GetOpt (int argc, char *argv[], char *optionS);
+void    timing_report (FILE *fp, const char *prefix, unsigned long n, double minutes);
+void    bench_report (const char *name, const char *setup, unsigned long n, double sec, double cpu);
+double  cputime (void);
+void    soak_window (unsigned long n, FILE *outfile);
+int     soak_report (void);
+
+/* --- counters and latency statistics (k2kmetrics.h) ---- */
+
+static struct k2kstats stats;
+
+/* --- what the instrument was told, to tell it again after an error ---- */
+
+static struct
+{
+    int     pad;                    /* GPIB address */
+    int     mode;                   /* index into scpi_mode[] */
+    int     display;                /* 0 to blank it */
+    int     retries;                /* recovery attempts, 0 = none */
+    unsigned long long timeout;     /* I/O timeout in ns, 0 = adaptive */
+    int     burst;                  /* readings per trigger */
+} cfg;
+
+static char *scpi_mode[] = {"volt:dc", "curr:dc", "res", "temp", "cont", "diod"};
+
+#define SETUP_SLOT  "4"             /* setup memory used by warm attach */
+#define MAXBOARD    16              /* GPIB boards looked at by -L */
+
+/* --- what the instruments k2000 knows can do ---- */
+
+static const struct model
+{
+    const char *id;                 /* in the reply to *idn? */
+    const char *name;
+    int     buffer;                 /* readings it can store, 0 = unknown */
+    int     rate;                   /* readings/s into the buffer, at best */
+    int     funcs;                  /* bit i set: can do scpi_mode[i] */
+} models[] =
+    {{"MODEL 2000,", "2000",  1024, 2000, 0x3f},
+     {"MODEL 2010,", "2010",  1024, 2000, 0x3f},
+     {"MODEL 2001,", "2001",   850, 2000, 0x0f},
+     {"MODEL 2002,", "2002",   850, 2000, 0x0f},
+     {"MODEL 2700,", "2700", 55000, 2000, 0x1f},    /* no diode test */
+     {"MODEL 2750,", "2750", 55000, 2000, 0x1f},
+     {"",            "unknown",  0,    0, 0x3f}};   /* last: matches any */
+
+#define BURST_MAX   64              /* readings per trigger, at most */
+#define BURST_NS    250000000ULL    /* ... and what a burst should take */
+
+/* --- intervals (0.1 s) that '+' and '-' step through while running ---- */
+
+static const int dt_steps[] = {0, 1, 2, 5, 10, 20, 50, 100, 200, 600};
+
+#define DT_STEPS    (int)(sizeof(dt_steps) / sizeof(dt_steps[0]))
+
+/* --- acquisition plan (-p): steps run one after the other ---- */
+
+#define MAXSTEP     64
+
+static struct
+{
+    int     mode, dt;               /* as -m, -t */
+    double  minutes;                /* how long, at most */
+    double  tol, settle;            /* done early, once within +-tol for
+                                       'settle' s; settle 0: never */
+} plan[MAXSTEP];
+
+static int  nstep = 0;
+static struct hist dead;            /* last reading of a step to the first
+                                       trigger of the next one */
+
+/* --- integration time of each mode after *rst, in power line cycles ---- */
+
+static const double scpi_plc[] = {1.0, 1.0, 1.0, 1.0, 0.01, 0.01};
+
+#define PLC_NS      20000000ULL     /* one cycle at 50 Hz, longer than at 60 */
+#define BYTE_NS     10000ULL        /* per byte, slow USB adapters included */
+
+static struct bus_rtt rtt;          /* round trip of ':read?' */
+
+/* --- soak test (-Z): cost per window of the run, see soak_window() ---- */
+
+#define SOAK_WINDOWS  10
+
+static struct
+{
+    double  days;                   /* length of the run, 0 if no soak test */
+    double  next;                   /* end of this window, s since the Epoch */
+    double  cpu, real;              /* cputime() and real time at its start */
+    unsigned long samples;          /* samples at its start */
+    struct hist flush;              /* real time for flush and plot */
+    int     n;                      /* windows done */
+    struct
+    {
+        double  days, cpu_us, flush_p99, flush_max, rss_kb, file_mb, real;
+        unsigned long samples;
+    } w[SOAK_WINDOWS+2];
+} soak;
+
+/* --- timing probes: cost nothing unless compiled with -DPROBE ---- */
+
+#ifdef PROBE
+enum { PH_TRIGGER, PH_READ, PH_PARSE, PH_SCREEN, PH_WRITE, PH_FLUSH, PH_PLOT, PH_KEY, PH_N };
+
+static const char *probe_name[PH_N] =
+    {"trigger", "read", "parse", "screen", "file write", "flush", "plot", "keyboard"};
+
+static struct
+{
+    unsigned long n;
+    unsigned long long sum, min, max;   /* ns */
+} probe[PH_N];
+
+static unsigned long long probe_t0;
+
+static inline unsigned long long probe_ns (void)
+{
+struct timespec ts;
+
+clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
+return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void probe_end (int ph)
+{
+unsigned long long dt = probe_ns() - probe_t0;
+
+if (!probe[ph].n++ || dt < probe[ph].min)
+    probe[ph].min = dt;
+if (dt > probe[ph].max)
+    probe[ph].max = dt;
+probe[ph].sum += dt;
+}
+
+void    probe_report (void);
+
+#define PROBE_BEGIN()       (probe_t0 = probe_ns())
+#define PROBE_END(ph)       probe_end (ph)
+#else
+#define PROBE_BEGIN()
+#define PROBE_END(ph)
+#endif
 
 
 int main (int argc, char *argv[])
 {
 static char *disclaimer =
 "\nk2000 - Data acquisition using the Keithley 2000 over GPIB. " VERSION ".\n"
-"Copyright (C) 2004...2017 by Joerg Hau.\n\n"
+"Copyright (C) 2004...2026 by Joerg Hau.\n\n"
 "This program is free software; you can redistribute it and/or modify it under\n"
 "the terms of the GNU General Public License, version 2, as published by the\n"
 "Free Software Foundation.\n\n"
@@ -104,29 +295,53 @@ static char *disclaimer =
 "WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A\n"
 "PARTICULAR PURPOSE. See the GNU General Public License for details.\n";
 
-static char *msg = "\nSyntax: k2000 [-h] [-a id] [-m mode] [-t dt] [-T timeout] [-d] [-w samp] [-f] [-c \"txt\"] [-g /path/to/gnuplot] [-n] datafile"
+static char *msg = "\nSyntax: k2000 [-h] [-a id] [-m mode] [-t dt] [-T timeout] [-d] [-w samp] [-f] [-c \"txt\"] [-g /path/to/gnuplot] [-n] [-M file] [-I sec] [-H port] [-X file] [-P file] [-F] [-S us] [-B file] [-Z days] [-r n] [-o ms] [-W ms] [-k] [-L] [-D sock] [-b sock] [-p plan] datafile"
 "\n        -h       this help screen"
 "\n        -a id    use instrument at GPIB address 'id' (default is 16)"
 "\n        -m mode  measurement mode (default is 0 for DCV)."
-"\n        -t dt    delay between measurements in 0.1 s (default is 10 = 1s)"
+"\n        -t dt    interval between measurements in 0.1 s (default is 10 = 1s)"
 "\n        -d       disable instrument display (default is on)"
 "\n        -w x     force write to disk every x samples (default is 100)."
 "\n        -f       force overwriting of existing file"
 "\n        -T min   stop acquisition after this time (in minutes; default 0 = endless)"
 "\n        -c txt   comment text"
 "\n        -g       specify path/to/gnuplot (if not in your current PATH)"
-"\n        -n       no graphics\n\n";
+"\n        -n       no graphics"
+"\n        -M file  write OpenMetrics health data to 'file'"
+"\n        -I sec   ... every 'sec' seconds (default is 15)"
+"\n        -H port  serve /metrics and /latest on localhost:port (or UNIX socket path)"
+"\n        -X file  trace all GPIB transactions to 'file' (see k2ktrdump)"
+"\n        -P file  no instrument: play back a session recorded with -X"
+"\n        -F       ... as fast as possible (default: at original speed)"
+"\n        -S us    no instrument: simulate one taking 'us' microseconds per reading"
+"\n        -B file  append benchmark results (JSON) to 'file'"
+"\n        -Z days  soak test: simulate 'days' of acquisition on a fast clock"
+"\n        -r n     on a bus error, try to recover n times (default 5, 0 = stop)"
+"\n        -o ms    fixed I/O timeout (default: adapted to the bus latency)"
+"\n        -W ms    IFC if a transaction hangs this long past its timeout (default 1000, 0 = off)"
+"\n        -k       warm attach: no reset if the instrument is set up already"
+"\n        -L       list the instruments on the bus, and quit"
+"\n        -D sock  daemon: no terminal, controlled through UNIX socket 'sock'"
+"\n        -b sock  share the bus: go through k2kbroker listening on 'sock'"
+"\n        -p plan  run the steps (mode, interval, duration) in file 'plan'\n\n";
 
 FILE    *outfile, *gp = NULL;
 char    inst[MAXLEN], buffer[MAXLEN], filename[MAXLEN], comment[MAXLEN] = "", gnuplot[MAXLEN];
-char    do_display = 1, do_graph = 1, do_overwrite = 0;
-int     dvm, pad = 16, key, do_flush = 100, delay = 10, mode = 0;
+char    metrics[MAXLEN] = "", labels[2*MAXLEN+32], http[MAXLEN] = "", trace[MAXLEN] = "", replay[MAXLEN] = "", bench[MAXLEN] = "";
+char    control[MAXLEN] = "", broker[MAXLEN] = "", planfile[MAXLEN] = "", text[MAXLEN];
+char    setup[4*MAXLEN], burst[BURST_MAX*32], *rest = "", *end;
+char    do_display = 1, do_graph = 1, do_overwrite = 0, do_fast = 0, do_warm = 0, do_list = 0;
+int     dvm, pad = 16, key, do_flush = 100, delay = 10, mode = 0, retries = 5;
 unsigned long loop = 0L;
-double  t0, t1;
+double  t0, t1, cpu0, tb = 0.0, step = 0.0, step_t0 = 0.0, ref = 0.0, ref_t = -1.0, v;
+long    latency = -1, timeout = 0, grace = 1000;
+unsigned long long expected;
+unsigned long long ns_start, ns_gap = 0, ns_trig = 0, ns_last = 0, ns_read = 0, ns_next, ns_metrics, ns_period = 0, ns_flush, *pending;
+int     npend = 0, i, n, interval = 15, ret = 0, attach, nb = 0, ib = 0;
+int     paused = 0, due = 0, k = 0, want_dt, want_mode, want_display, set_dt, set_mode, set_disp;
+const struct model *model;
 float   tstop = 0.0;
 time_t  t;
-static char *scpi_mode[] = {"volt:dc", "curr:dc", "res", "temp", "cont", "diod"};
-
 /* --- gnuplot labels. we could actually query these from the instrument ;-) */
 static char *ylabels[]   = {"V", "mA", "Ohm", "degrees C", "Ohm", "mV"}; 
 
@@ -138,7 +353,7 @@ fprintf (stderr, disclaimer);
 
 /* --- decode and read the command line --- */
 
-while ((key = GetOpt(argc, argv, "hfnda:w:t:T:m:c:g:")) != EOF)
+while ((key = GetOpt(argc, argv, "hfndFkLa:w:t:T:m:c:g:M:I:H:X:P:S:B:Z:r:o:W:D:b:p:")) != EOF)
     switch (key)
         {
         case 'h':                    /* help me */
@@ -160,6 +375,87 @@ while ((key = GetOpt(argc, argv, "hfnda:w:t:T:m:c:g:")) != EOF)
         case 'g':
             sscanf (optarg, "%80s", gnuplot);
             continue;
+        case 'M':
+            sscanf (optarg, "%120s", metrics);
+            continue;
+        case 'H':
+            sscanf (optarg, "%120s", http);
+            continue;
+        case 'X':
+            sscanf (optarg, "%120s", trace);
+            continue;
+        case 'D':
+            sscanf (optarg, "%120s", control);
+            continue;
+        case 'b':
+            sscanf (optarg, "%120s", broker);
+            continue;
+        case 'p':
+            sscanf (optarg, "%120s", planfile);
+            continue;
+        case 'P':
+            sscanf (optarg, "%120s", replay);
+            continue;
+        case 'F':
+            do_fast = 1;
+            continue;
+        case 'k':
+            do_warm = 1;
+            continue;
+        case 'L':
+            do_list = 1;
+            continue;
+        case 'S':
+            sscanf (optarg, "%9ld", &latency);
+            if (latency < 0)
+                {
+                puts("Error: latency must be positive.");
+                return 1;
+                }
+            continue;
+        case 'B':
+            sscanf (optarg, "%120s", bench);
+            continue;
+        case 'r':
+            sscanf (optarg, "%5d", &retries);
+            if (retries < 0)
+                {
+                puts("Error: number of recovery attempts must be positive.");
+                return 1;
+                }
+            continue;
+        case 'o':
+            sscanf (optarg, "%9ld", &timeout);
+            if (timeout < 1)
+                {
+                puts("Error: timeout must be at least 1 ms.");
+                return 1;
+                }
+            continue;
+        case 'W':
+            sscanf (optarg, "%9ld", &grace);
+            if (grace < 0)
+                {
+                puts("Error: watchdog time must be positive.");
+                return 1;
+                }
+            continue;
+        case 'Z':
+            sscanf (optarg, "%lg", &soak.days);
+            if (soak.days <= 0.0)
+                {
+                puts("Error: soak test duration must be positive.");
+                return 1;
+                }
+            continue;
+        case 'I':
+            sscanf (optarg, "%6d", &interval);
+            if (interval < 1)
+                {
+                puts("Error: metrics interval must be at least 1 s.");
+                return 1;
+                }
+            continue;
         case 'w':
             sscanf (optarg, "%5d", &do_flush);
             continue;
@@ -202,6 +498,34 @@ while ((key = GetOpt(argc, argv, "hfnda:w:t:T:m:c:g:")) != EOF)
             return 1;
         }
 
+/* --- a plan sets mode and interval, step by step --- */
+
+if (planfile[0])
+    {
+    if (!plan_load (planfile))
+        return 1;
+    mode = plan[0].mode;
+    delay = plan[0].dt;
+    }
+
+/* --- the bus may be shared: then the broker owns it, and guards it
+       with its own watchdog --- */
+
+if (broker[0] && latency < 0 && !replay[0])
+    {
+    snprintf (buffer, sizeof(buffer), "k2000 pad %d pid %d", pad, (int)getpid ());
+    if (!bus_broker (broker, buffer, 1))
+        return ERR_INST;
+    grace = 0;
+    }
+
+if (do_list)                    /* no data file needed for this */
+    {
+    if (latency >= 0)
+        bus_simulate (latency);
+    return inst_list ();
+    }
+
 if (argv[optind] == NULL)	    /* we need at least one parameter on command line */
     {
     fprintf (stderr, msg);
@@ -212,6 +536,11 @@ if (argv[optind] == NULL)	    /* we need at least one parameter on command line
 /* --- prepare output data file --- */
 
 strcpy (filename, argv[optind]);
+if ((!access(filename, 0)) && (!do_overwrite) && control[0])	/* nobody to ask */
+    {
+    fprintf (stderr, "File '%s' exists, use -f to overwrite.\n", filename);
+    return 1;
+    }
 if ((!access(filename, 0)) && (!do_overwrite))	 // If file exists and overwrite is NOT forced
 	{
 	fprintf (stderr, "\a\nFile '%s' exists - Overwrite? [Y/*] ", filename);
@@ -226,68 +555,116 @@ if ((!access(filename, 0)) && (!do_overwrite))	 // If file exists and overwrite
 		}
 	}
 	
+ns_start = nanotime();
 if (NULL == (outfile = fopen(filename, "wt")))
     {
     fprintf(stderr, "Could not open '%s' for writing.\n", filename);
     return ERR_FILE;
     }
 
+if (control[0])                 /* daemon: nobody to look at a plot */
+    do_graph = 0;
+
+/* --- prepare gnuplot: it takes a while to start, so do it now and
+       let it start while we set up the instrument --- */
+
+if (do_graph && NULL == (gp = popen(gnuplot, "w")))
+	{
+	fprintf(stderr, "\nCannot launch gnuplot, will continue \"as is\".\n") ;
+	fflush(stderr);
+	do_graph = 0;	/* do not abort here, just continue */
+	};
+
+if (do_graph)	/* prepare gnuplot display defaults */
+    {
+    fprintf(gp, "set mouse;set mouse labels; set style data lines; set title '%s'\n", filename);
+    fprintf(gp, "set grid xt; set grid yt; set xlabel 'min'; set ylabel '%s'\n", ylabels[mode]);
+    fflush (gp);
+    }
+
+/* --- record the bus traffic, if asked for; stopped by exit() --- */
+
+if (trace[0])
+    {
+    if (!trace_start (trace, TRACE_DATA))
+        return ERR_FILE;
+    atexit (trace_stop);
+    }
+
+/* --- ... or play back a recorded one --- */
+
+if (replay[0])
+    {
+    if (!bus_replay (replay, do_fast))
+        return ERR_FILE;
+    if (do_fast)
+        delay = 0;
+    }
+else if (latency >= 0 || soak.days > 0.0)
+    bus_simulate (latency > 0 ? latency : 0);
+
+/* --- soak test: run for 'days', skipping all idle time --- */
+
+if (soak.days > 0.0)
+    {
+    clock_virtual ();
+    tstop = soak.days * 1440.0;
+    }
+
+/* --- watch out for hanging bus transactions; stopped by exit() --- */
+
+if (grace > 0 && dog_start (0, grace * 1000000ULL))
+    atexit (dog_stop);
+
 /* --- now connect to the instrument --- */
 
-dvm = ibdev(0, pad, 0, T1s, 1, 0);
+cfg.pad = pad;
+cfg.mode = mode;
+cfg.display = do_display;
+cfg.retries = retries;
+cfg.timeout = timeout * 1000000ULL;
+
+dvm = bus_dev(0, pad, 0, T1s, 1, 0);
 if(dvm < 0)
     {
     fprintf(stderr, "ibdev: error trying to open %i: quit.\n", pad);
-    if (do_graph) pclose(gp);
+    if (gp) pclose(gp);
     return ERR_INST;
     }
 
-if (!inst_write (dvm, "*rst;*cls;:form:elem read,unit;*opc"))
-    return ERR_INST;
+if (cfg.timeout)
+    bus_timeout (dvm, cfg.timeout);
 
 /* Query ID of instrument, save into inst[] */
 if (!inst_write (dvm, "*idn?"))     
     return ERR_INST;
-if( ibrd(dvm, inst, MAXLEN-1) & ERR)
+if( bus_read(dvm, inst, MAXLEN-1) & ERR)
     {
-    fprintf(stderr, "Error reading instrument ID (%d), something is wrong here.\n", ibcnt);
+    fprintf(stderr, "Error reading instrument ID (%d), something is wrong here.\n", bus_cnt);
     return ERR_INST;
     }
-inst[ibcnt-1] = 0x0;        /* string has CRLF, so remove the LF */
+inst[bus_cnt-1] = 0x0;        /* string has CRLF, so remove the LF */
 
-if (!do_display)            /* if blanked, display message */
+/* what can it do? As fast as possible, readings are taken in bursts
+   into its buffer, if it has one: one bus transaction for many */
+model = model_find (inst);
+if (!(model->funcs & (1 << mode)))
     {
-    if (0 == inst_write (dvm, ":DISP:TEXT:DATA '-ACQUIRING- ';:DISP:TEXT:STAT 1")) 
-        return ERR_INST;
+    fprintf(stderr, "Model %s cannot do '%s'.\n", model->name, scpi_mode[mode]);
+    return ERR_INST;
     }
+for (i = 0; i < nstep; i++)
+    if (!(model->funcs & (1 << plan[i].mode)))
+        {
+        fprintf(stderr, "Plan step %d: model %s cannot do '%s'.\n", i + 1, model->name,
+                scpi_mode[plan[i].mode]);
+        return ERR_INST;
+        }
+cfg.burst = burst_len (model, delay, mode);
 
-/* FIXME: query for any static errors and read result. */ 
-
-/* set mode by copying the relevant string from the pre-defined array */
-strcpy (buffer, ":func '");
-strcat (buffer, scpi_mode[mode]);
-strcat (buffer, "';:init; *opc\n");
-#ifdef DEBUG
-    fputs(stderr, buffer);
-#endif
-if (!inst_write (dvm, buffer))
+if (!(attach = do_warm ? inst_attach (dvm) : inst_setup (dvm)))
     return ERR_INST;
 
-/* --- prepare gnuplot --- */
-
-if (NULL == (gp = popen("gnuplot","w")))
-	{
-	fprintf(stderr, "\nCannot launch gnuplot, will continue \"as is\".\n") ;
-	fflush(stderr);
-	do_graph = 0;	/* do not abort here, just continue */
-	};
-
-if (do_graph)	/* prepare gnuplot display defaults */
-    {
-    fprintf(gp, "set mouse;set mouse labels; set style data lines; set title '%s'\n", filename);
-    fprintf(gp, "set grid xt; set grid yt; set xlabel 'min'; set ylabel '%s'\n", ylabels[mode]);
-    fflush (gp);
-    }
 
 /* --- Set up on-screen display --- */
 
@@ -296,94 +673,457 @@ printf("\n  Output file :  %s", filename);
 if (strlen(comment))
 	printf("\n      Comment :  %s", comment);
 printf("\n      Refresh :  %d", do_flush);
+if (do_warm)
+    printf("\n        Setup :  %s", attach == 3 ? "unchanged" : attach == 2 ? "recalled" : "full");
+printf("\n        Model :  %s", model->name);
+if (cfg.burst > 1)
+    printf(", bursts of %d readings", cfg.burst);
 if (tstop > 0.0)
     printf("\n   Halt after :  %g min", tstop);
-printf("\n         Stop :  Press 'q' or ESC.\n");
-printf("\n     Count           Time      Reading\n");
+if (nstep)
+    printf("\n         Plan :  %s, %d step(s)", planfile, nstep);
+if (control[0])
+    printf("\n      Control :  %s\n", control);
+else
+    printf("\n         Stop :  Press 'q' or ESC."
+           "\n       Change :  '+'/'-' interval, 'm' mode, 'd' display\n");
+if (!control[0])
+    printf("\n     Count           Time      Reading\n");
 fflush(stdout);
 
 /* Get time, write file header */
-time(&t);
+t = (time_t)timeinfo();
 fprintf(outfile, "# k2000 " VERSION "\n");
 fprintf(outfile, "# Instrument: %s\n", inst);
 fprintf(outfile, "# %s\n", comment);
+if (cfg.burst > 1)
+    fprintf(outfile, "# Bursts of %d readings, times in between interpolated\n", cfg.burst);
 fprintf(outfile, "# Acquisition start: %s", ctime(&t));
 fprintf(outfile, "# min\treadout\n");
 t0 = timeinfo();
+if (nstep)
+    {
+    step_text (text, sizeof(text), 0);
+    fprintf(outfile, "# Step 1 of %d: 0.0000 min, %s\n", nstep, text);
+    }
+inst_errors (dvm, outfile, t0);     /* anything wrong with the setup? */
 
-init_keyboard();    /* initiate kbhit() functionality */
+/* time stamps of samples not yet flushed to the file */
+if (do_flush < 1)
+    do_flush = 1;
+if (NULL == (pending = malloc (do_flush * sizeof(*pending))))
+    {
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+    }
+
+stats.start = t0;
+metrics_labels (labels, sizeof(labels), pad, filename);
+ns_next = ns_metrics = clock_ns();
+if (http[0] && !http_start (http, &stats, labels))
+    fprintf(stderr, "Will continue without HTTP endpoint.\n");
+if (control[0] && !ctl_start (control, &stats))
+    return 1;
+snprintf (text, sizeof(text), "dt=%d mode=%d display=%s", delay, mode, cfg.display ? "on" : "off");
+ctl_config (text);
+want_dt = delay;
+want_mode = mode;
+want_display = cfg.display;
+
+/* what a reading should take: integration, and sending the result */
+expected = cfg.burst * (scpi_plc[mode] * 3 * PLC_NS + 90 * BYTE_NS);
+
+if (!control[0])
+    init_keyboard();    /* initiate kbhit() functionality */
+cpu0 = cputime();
+if (soak.days > 0.0)
+    {
+    soak.real = nanotime() / 1e9;
+    soak.cpu = cpu0;
+    soak.next = t0 + soak.days * 86400.0 / SOAK_WINDOWS;
+    hist_clear (&soak.flush);
+    }
 
 key = 0;
 do  {
-    if (delay > 0)
-        usleep (delay * 100000.0);
+    /* daemon: see to what the control socket asks for, between samples */
+    while (control[0] && (i = ctl_next (text, sizeof(text))) != CTL_NONE)
+        {
+        if (i == CTL_QUIT)
+            key = ESC;
+        else if (i == CTL_MARK)
+            fprintf(outfile, "# Mark: %.4f min, %s\n", (timeinfo() - t0) / 60.0, text);
+        else if (i == CTL_SET && 3 == sscanf (text, "dt %d mode %d display %d", &set_dt, &set_mode, &set_disp))
+            {
+            if (set_dt >= 0)
+                want_dt = set_dt;
+            if (set_mode >= 0)
+                want_mode = set_mode;
+            if (set_disp >= 0)
+                want_display = set_disp;
+            }
+        else if (i == CTL_STOP && !paused)
+            fprintf(outfile, "# Stopped: %.4f min\n", (timeinfo() - t0) / 60.0);
+        else if (i == CTL_START && paused)
+            {
+            fprintf(outfile, "# Started: %.4f min\n", (timeinfo() - t0) / 60.0);
+            ns_next = clock_ns();
+            ns_last = 0;
+            due = 0;
+            }
+        if (i == CTL_STOP || i == CTL_START)
+            ctl_paused (paused = (i == CTL_STOP));
+        }
+    if (key == ESC)
+        break;
+    if (paused)
+        {
+        ctl_sleep_until (clock_ns() + 1000000000ULL);
+        continue;
+        }
 
-    if (!inst_write (dvm, ":read?"))
+    /* a change of the setup is made between two triggers, so a burst
+       is never cut in two; only what changes is sent */
+    if (!*rest && (want_dt != delay || want_mode != mode || want_display != cfg.display))
         {
-        if (gp) 
-            pclose(gp);
-        fclose (outfile);
-        close_keyboard();  
-        return ERR_INST;
+        if (!(model->funcs & (1 << want_mode)))
+            {
+            fprintf(stderr, "\nModel %s cannot do '%s'.\n", model->name, scpi_mode[want_mode]);
+            want_mode = mode;
+            }
+        if (!inst_change (dvm, want_mode, want_display, burst_len (model, want_dt, want_mode)) &&
+            !inst_recover (&dvm, outfile, t0, "error changing the setup"))
+            break;
+        if (want_dt != delay)       /* a new schedule, from now */
+            {
+            ns_next = clock_ns();
+            ns_last = 0;
+            due = 0;
+            }
+        if (want_mode != mode && do_graph)
+            {
+            fprintf(gp, "set ylabel '%s'\n", ylabels[want_mode]);
+            fflush (gp);
+            }
+        delay = want_dt;
+        mode = want_mode;
+        expected = cfg.burst * (scpi_plc[mode] * 3 * PLC_NS + 90 * BYTE_NS);
+        memset (&rtt, 0, sizeof(rtt));      /* what was seen does not hold any more */
+        fprintf(outfile, "# Config: %.4f min, interval %.1f s, mode %s, display %s, burst %d\n",
+                (timeinfo() - t0) / 60.0, delay / 10.0, scpi_mode[mode],
+                cfg.display ? "on" : "off", cfg.burst);
+        if (!control[0])
+            printf("\nConfig: interval %.1f s, mode %s, display %s, burst %d\n",
+                   delay / 10.0, scpi_mode[mode], cfg.display ? "on" : "off", cfg.burst);
+        snprintf (text, sizeof(text), "dt=%d mode=%d display=%s", delay, mode, cfg.display ? "on" : "off");
+        ctl_config (text);
+        }
+
+    if (!*rest)                     /* all of the last burst is written */
+        {
+        /* wait for the next sampling time; if it has passed already, we
+           are too slow: count an overrun and start afresh from now. The
+           first reading (and the first after a recovery) is taken at once */
+        if (delay > 0 && ns_last)
+            {
+            if (!due)
+                {
+                ns_next += delay * 100000000ULL;
+                if (clock_ns() > ns_next)
+                    {
+                    stats_begin (&stats);
+                    stats.overruns++;
+                    stats_end (&stats);
+                    ns_next = clock_ns();
+                    }
+                due = 1;
+                }
+            if (!ctl_sleep_until (ns_next))     /* woken up by a command */
+                continue;
+            due = 0;
+            }
+
+        /* time out soon after the slowest reading seen recently */
+        if (!cfg.timeout)
+            bus_timeout (dvm, bus_rtt_timeout (&rtt, expected));
+
+        ns_trig = clock_ns();
+        if (ns_gap)                 /* first trigger of a new step */
+            {
+            hist_add (&dead, ns_trig - ns_gap);
+            ns_gap = 0;
+            }
+        ns_period = ns_last ? ns_trig - ns_last : 0;
+        ns_last = ns_trig;
+
+        PROBE_BEGIN();
+        if (!inst_write (dvm, ":read?") && !bus_eof)
+            {
+            if (inst_recover (&dvm, outfile, t0, "error sending ':read?'"))
+                {
+                ns_next = clock_ns();
+                ns_last = 0;
+                continue;
+                }
+            ret = ERR_INST;         /* given up: shut down as usual */
+            break;
+            }
+        PROBE_END(PH_TRIGGER);
+        if (bus_eof)                    /* end of the recorded session */
+            break;
+
+        PROBE_BEGIN();
+        if(bus_read(dvm, burst, sizeof(burst)-1) & ERR)
+            {
+            if (bus_eof)
+                break;
+            fprintf(stderr, "Error trying to read ...\n");
+            stats_begin (&stats);
+            stats.errors++;
+            if (bus_err == EABO)
+                stats.timeouts++;
+            stats_end (&stats);
+            if (bus_err == EABO)
+                bus_rtt_backoff (&rtt);
+            if (inst_recover (&dvm, outfile, t0, "error reading"))
+                {
+                ns_next = clock_ns();
+                ns_last = 0;
+                continue;
+                }
+            ret = ERR_INST;
+            break;
+            }
+        PROBE_END(PH_READ);
+        ns_read = clock_ns();
+        bus_rtt_add (&rtt, ns_read - ns_trig);
+
+        /* the readings of a burst are separated by commas; their times
+           are spread evenly from trigger to reply */
+        burst[bus_cnt] = 0x0;
+        strclean (burst);           /* string has CRLF */
+        for (nb = 1, i = 0; burst[i]; i++)
+            if (burst[i] == ',')
+                nb++;
+        tb = timeinfo();
+        step = (ns_read - ns_trig) / 1e9 / nb;
+        ib = 0;
+        rest = burst;
         }
 
-    if(ibrd(dvm, buffer, 90) & ERR)
-    	{
-       	fprintf(stderr, "Error trying to read ...\n");
-    	break;
-       	}
-    buffer[ibcnt-1] = 0x0;        /* string has CRLF, so remove the LF */
+    PROBE_BEGIN();
+    n = strcspn (rest, ",");
+    snprintf (buffer, sizeof(buffer), "%.*s", n, rest);
+    rest += n;
+    if (*rest)
+        rest++;
 
     if (!strcmp(buffer, "+9.9E37"))
         strcpy(buffer, "OVERFLOW");
 
-    // FIXME: more error checks ?
+    /* instrument errors: see the SRQ check below, inst_errors() */
 
-    t1 = (timeinfo()-t0)/60.0;
-    printf("%10lu %10.2f min    %s\r", ++loop, t1, buffer);
-    fprintf(outfile, "%.4f\t%s\n", t1, buffer);	// write literally to file
-    fflush (stdout);
+    t1 = (tb - (nb - 1 - ib++) * step - t0) / 60.0;
+    PROBE_END(PH_PARSE);
+
+    PROBE_BEGIN();
+    loop++;
+    if (!control[0])
+        {
+        printf("%10lu %10.2f min    %s\r", loop, t1, buffer);
+        fflush (stdout);
+        }
+    PROBE_END(PH_SCREEN);
+
+    PROBE_BEGIN();
+    n = fprintf(outfile, "%.4f\t%s\n", t1, buffer);	// write literally to file
+    PROBE_END(PH_WRITE);
+    pending[npend++] = ns_read;
+
+    if (bus_srq (0))                /* costs no bus transaction */
+        inst_errors (dvm, outfile, t0);
+
+    stats_begin (&stats);
+    if (!stats.samples)
+        stats.first_ns = nanotime() - ns_start;
+    if (ib == 1)                    /* once per trigger */
+        {
+        if (ns_period)
+            hist_add (&stats.period, ns_period);
+        hist_add (&stats.bus, ns_read - ns_trig);
+        }
+    if (n > 0)
+        stats.bytes += n;
+    stats.last_time = t0 + t1 * 60.0;
+    snprintf (stats.last, sizeof(stats.last), "%s", buffer);
+    stats.latest[stats.samples % LATEST].time = stats.last_time;
+    snprintf (stats.latest[stats.samples % LATEST].text, sizeof(stats.latest[0].text), "%s", buffer);
+    stats.samples++;
+    stats.stalls = dog_stalls();
+    stats.stall_ns = dog_recovery_ns();
+    stats_end (&stats);
 
     /* handle timeout */
     if ((t1 > tstop) && (tstop > 0.0))
         key = ESC;
+
+    /* plan: settled means all readings within +-tol of the first one
+       for 'settle' s; an overflow starts over */
+    if (nstep)
+        {
+        v = strtod (buffer, &end);
+        if (end == buffer || ref_t < 0.0 || fabs (v - ref) > plan[k].tol)
+            {
+            ref = v;
+            ref_t = (end == buffer) ? -1.0 : t1;
+            }
+        }
+
+    /* ... on to the next step when this one has run its time, or has
+       settled; not within a burst */
+    if (nstep && !*rest && (t1 - step_t0 >= plan[k].minutes ||
+        (plan[k].settle > 0.0 && ref_t >= 0.0 && (t1 - ref_t) * 60.0 >= plan[k].settle)))
+        {
+        if (++k == nstep)
+            key = ESC;
+        else
+            {
+            step_t0 = (timeinfo() - t0) / 60.0;
+            ref_t = -1.0;
+            want_dt = plan[k].dt;
+            want_mode = plan[k].mode;
+            ns_next = clock_ns();   /* the first reading at once */
+            ns_last = 0;
+            due = 0;
+            ns_gap = ns_read;
+            step_text (text, sizeof(text), k);
+            fprintf(outfile, "# Step %d of %d: %.4f min, %s\n", k + 1, nstep, step_t0, text);
+            if (!control[0])
+                printf("\nStep %d of %d: %s\n", k + 1, nstep, text);
+            }
+        }
 	
     /* ensure write & display at least every x data points */
     if (!(loop % do_flush))
         {
+        PROBE_BEGIN();
+        ns_flush = nanotime();
        	fflush (outfile);
+        PROBE_END(PH_FLUSH);
+        ns_read = clock_ns();
+        stats_begin (&stats);
+        for (i = 0; i < npend; i++)
+            hist_add (&stats.disk, ns_read - pending[i]);
+        stats_end (&stats);
+        npend = 0;
         if (do_graph)
             {
+            PROBE_BEGIN();
             fprintf(gp, "plot '%s' with lines title ''\n", filename);
             fflush (gp);
+            PROBE_END(PH_PLOT);
             }
+        if (soak.days > 0.0)
+            hist_add (&soak.flush, nanotime() - ns_flush);
+        }
+
+    /* soak test: take stock every 1/SOAK_WINDOWS of the run */
+    if (soak.days > 0.0 && t0 + t1 * 60.0 >= soak.next)
+        soak_window (loop, outfile);
+
+    /* health data for the monitoring */
+    if (metrics[0] && ns_read - ns_metrics >= interval * 1000000000ULL)
+        {
+        metrics_file (metrics, &stats, labels, timeinfo());
+        ns_metrics = ns_read;
         }
 
     /* look up keyboard for keypress */
-    if(kbhit())
+    PROBE_BEGIN();
+    if(!control[0] && kbhit())
         key = readch();
+    PROBE_END(PH_KEY);
+    switch (key)                    /* changes are made at the next trigger */
+        {
+        case '+':
+            for (i = 0; i < DT_STEPS - 1 && dt_steps[i] <= want_dt; i++)
+                ;
+            want_dt = (dt_steps[i] > want_dt) ? dt_steps[i] : want_dt;
+            break;
+        case '-':
+            for (i = DT_STEPS - 1; i > 0 && dt_steps[i] >= want_dt; i--)
+                ;
+            want_dt = (dt_steps[i] < want_dt) ? dt_steps[i] : want_dt;
+            break;
+        case 'm':
+            for (i = 1; i < 6 && !(model->funcs & (1 << (want_mode + i) % 6)); i++)
+                ;
+            want_mode = (want_mode + i) % 6;
+            break;
+        case 'd':
+            want_display = !want_display;
+            break;
+        }
+    if (key != 'q' && key != ESC)   /* taken */
+        key = 0;
 	}
 	while ((key != 'q') && (key != ESC));
 
-time(&t);
+fflush (outfile);
+if (soak.days > 0.0 && loop > soak.samples)
+    soak_window (loop, outfile);
+ns_read = clock_ns();
+stats_begin (&stats);
+for (i = 0; i < npend; i++)
+    hist_add (&stats.disk, ns_read - pending[i]);
+stats_end (&stats);
+free (pending);
+if (metrics[0])
+    metrics_file (metrics, &stats, labels, timeinfo());
+http_stop ();
+ctl_stop ();
+
+t1 = (timeinfo()-t0)/60.0;
+timing_report (outfile, "# ", loop, t1);
+t = (time_t)timeinfo();
 fprintf(outfile, "# Acquisition stop: %s\n", ctime(&t));
 fclose (outfile);
-close_keyboard();   /* from kbhit() stuff */
+if (!control[0])
+    close_keyboard();   /* from kbhit() stuff */
+fprintf(stderr, "\n\n");
+timing_report (stderr, "", loop, t1);
+if (bench[0])
+    {
+    snprintf (setup, sizeof(setup),
+              "\"transport\": \"%s\", \"latency_us\": %ld, \"dt\": %d, \"mode\": \"%s\", "
+              "\"burst\": %d, \"flush\": %d, \"graph\": %d, \"metrics\": %d, \"http\": %d, "
+              "\"trace\": %d",
+              replay[0] ? "replay" : latency >= 0 ? "simulator" : broker[0] ? "broker" : "gpib", latency,
+              delay, scpi_mode[mode], cfg.burst, do_flush, do_graph, metrics[0] != 0, http[0] != 0,
+              trace[0] != 0);
+    bench_report (bench, setup, loop, t1 * 60.0, cputime() - cpu0);
+    }
+if (soak.days > 0.0 && soak_report ())
+    ret = ERR_SOAK;
 
-if (do_graph)
+if (gp)
     pclose(gp);
 
-if (!do_display)            /* if blanked, display message */
+#ifdef PROBE
+probe_report ();
+#endif
+
+if (!cfg.display)           /* if blanked, display message */
     {
     if (0 == inst_write (dvm, ":DISP:TEXT:STAT 0")) 
         return ERR_INST;
     }
 
-if (!inst_write (dvm, "syst:pres"))     /* Read system ID into *inst */
+if (!do_warm && !inst_write (dvm, "syst:pres"))     /* leave it set up for the next run */
     return ERR_INST;
 
 printf("\n\n");
-return 0;
+return ret;
 }
 
 
@@ -395,29 +1135,645 @@ return 0;
 ********************************************************/
 int inst_write (const int dvm, const char *cmd)
 {
-if (ibwrt(dvm, cmd, strlen(cmd)) & ERR )
+if (bus_write(dvm, cmd, strlen(cmd)) & ERR )
     {
-    fprintf(stderr, "Error sending '%s': %d\n", cmd, iberr);
+    fprintf(stderr, "Error sending '%s': %d\n", cmd, bus_err);
+    stats_begin (&stats);
+    stats.errors++;
+    if (bus_err == EABO)
+        stats.timeouts++;
+    stats_end (&stats);
     return 0;
     }
 return 1;
 }
 
 
+/********************************************************
+* inst_setup: Brings the instrument into the state we   *
+*             want, from whatever state it is in.       *
+* Input:    - instrument ID                             *
+* Return:   1 if OK, 0 if error                         *
+* Note:     Uses cfg, so it can be called again after   *
+*           a bus error.                                *
+********************************************************/
+int inst_setup (const int dvm)
+{
+char    buffer[MAXLEN];
+
+if (!inst_write (dvm, "*rst;*cls;*sre 4;:form:elem read,unit;*opc"))
+    return 0;
+
+if (!cfg.display)           /* if blanked, display message */
+    {
+    if (0 == inst_write (dvm, ":DISP:TEXT:DATA '-ACQUIRING- ';:DISP:TEXT:STAT 1")) 
+        return 0;
+    }
+
+/* set mode by copying the relevant string from the pre-defined array */
+strcpy (buffer, ":func '");
+strcat (buffer, scpi_mode[cfg.mode]);
+strcat (buffer, "'");
+if (cfg.burst > 1)          /* readings per trigger, into the buffer */
+    sprintf (buffer + strlen (buffer), ";:samp:coun %d", cfg.burst);
+strcat (buffer, ";:init; *opc\n");
+#ifdef DEBUG
+    fputs(buffer, stderr);
+#endif
+return inst_write (dvm, buffer);
+}
+
+
+/********************************************************
+* inst_attach: Like inst_setup(), but leaves the        *
+*              instrument alone if it is set up as we   *
+*              want already (warm attach).              *
+* Input:    - instrument ID                             *
+* Return:   0 if error, else how it was done: 1 full    *
+*           setup, 2 recalled, 3 nothing to change      *
+* Note:     A reset disturbs the instrument (filters,   *
+*           autozero, ranging) and takes its time. So   *
+*           look at the settings first; if they are not *
+*           ours, try the setup saved by an earlier run *
+*           (*rcl), and only then do a full setup and   *
+*           save it (*sav) for the next run.            *
+********************************************************/
+int inst_attach (const int dvm)
+{
+char    buffer[MAXLEN];
+int     how = 3;
+
+if (!inst_check (dvm))
+    {
+    if (!inst_write (dvm, "*rcl " SETUP_SLOT))
+        return 0;
+    how = 2;
+    if (!inst_check (dvm))
+        return (inst_setup (dvm) && inst_write (dvm, "*sav " SETUP_SLOT)) ? 1 : 0;
+    }
+
+/* what *rst and *sav leave alone: status reporting, display text;
+   and the burst length, which may have been another one */
+snprintf (buffer, sizeof(buffer), "*cls;*sre 4;:samp:coun %d", cfg.burst);
+if (!inst_write (dvm, buffer))
+    return 0;
+if (!inst_write (dvm, cfg.display ? ":DISP:TEXT:STAT 0" :
+                      ":DISP:TEXT:DATA '-ACQUIRING- ';:DISP:TEXT:STAT 1"))
+    return 0;
+return how;
+}
+
+
+/********************************************************
+* inst_change: Changes the setup while running, sending *
+*              only what differs from cfg.              *
+* Input:    - instrument ID                             *
+*           - new mode, display, readings per trigger   *
+* Return:   1 if OK, 0 if error                         *
+* Note:     cfg is changed in any case, so a recovery   *
+*           after an error sets up the new one.         *
+********************************************************/
+int inst_change (const int dvm, int mode, int display, int burst)
+{
+char    buffer[2*MAXLEN] = "";
+int     k = 0;
+
+if (mode != cfg.mode)
+    k += snprintf (buffer + k, sizeof(buffer) - k, ";:func '%s'", scpi_mode[mode]);
+if (burst != cfg.burst)
+    k += snprintf (buffer + k, sizeof(buffer) - k, ";:samp:coun %d", burst);
+if (display != cfg.display)
+    k += snprintf (buffer + k, sizeof(buffer) - k, display ? ";:DISP:TEXT:STAT 0" :
+                   ";:DISP:TEXT:DATA '-ACQUIRING- ';:DISP:TEXT:STAT 1");
+cfg.mode = mode;
+cfg.display = display;
+cfg.burst = burst;
+if (!k)                     /* just the interval, nothing to send */
+    return 1;
+#ifdef DEBUG
+    fprintf(stderr, "%s\n", buffer + 1);
+#endif
+return inst_write (dvm, buffer + 1);
+}
+
+
+/********************************************************
+* inst_check: Asks whether the instrument is set up as  *
+*             inst_setup() would do it.                 *
+* Input:    - instrument ID                             *
+* Return:   1 if so, 0 if not or error                  *
+********************************************************/
+int inst_check (const int dvm)
+{
+char    buffer[MAXLEN], want[MAXLEN];
+int     i, k;
+
+if (!inst_write (dvm, ":func?;:form:elem?") || (bus_read (dvm, buffer, MAXLEN-1) & ERR))
+    return 0;
+buffer[bus_cnt] = 0x0;
+strclean (buffer);
+for (i = k = 0; buffer[i]; i++)     /* '"VOLT:DC";READ,UNIT' */
+    if (buffer[i] != '"')
+        buffer[k++] = tolower (buffer[i]);
+buffer[k] = 0x0;
+snprintf (want, sizeof(want), "%s;read,unit", scpi_mode[cfg.mode]);
+return !strcmp (buffer, want);
+}
+
+
+/********************************************************
+* inst_list: Lists the instruments on all boards, and   *
+*            marks those k2000 can work with.           *
+* Input:    Nothing.                                    *
+* Return:   0 if some were found, else ERR_INST         *
+* Note:     Finding listeners costs no timeouts. "*idn?"*
+*           is then sent to all of them before reading  *
+*           the first answer, so the instruments make   *
+*           them up at the same time.                   *
+********************************************************/
+int inst_list (void)
+{
+char    buffer[MAXLEN];
+int     pads[30], ud[30], b, i, n, found = 0;
+unsigned long long ns = nanotime();
+
+for (b = 0; b < MAXBOARD; b++)
+    {
+    if ((n = bus_find (b, pads, 30)) < 0)
+        continue;
+    printf("Board %d: %d listener(s)\n", b, n);
+    for (i = 0; i < n; i++)
+        {
+        ud[i] = bus_dev (b, pads[i], 0, T300ms, 1, 0);
+        if (ud[i] >= 0 && (bus_write (ud[i], "*idn?", 5) & ERR))
+            {
+            bus_close (ud[i]);
+            ud[i] = -1;
+            }
+        }
+    for (i = 0; i < n; i++)
+        {
+        strcpy (buffer, "(no answer to *idn?)");
+        if (ud[i] >= 0)
+            {
+            if (!(bus_read (ud[i], buffer, MAXLEN-1) & ERR))
+                {
+                buffer[bus_cnt] = 0x0;
+                strclean (buffer);
+                }
+            bus_close (ud[i]);
+            }
+        if (model_find (buffer)->buffer)
+            printf("  %2d  %s  <- k2000 (%s)\n", pads[i], buffer, model_find (buffer)->name);
+        else
+            printf("  %2d  %s\n", pads[i], buffer);
+        found++;
+        }
+    }
+printf("%d instrument(s) found in %.3f s.\n", found, (nanotime() - ns) / 1e9);
+return found ? 0 : ERR_INST;
+}
+
+
+/********************************************************
+* model_find: Looks up what an instrument can do.       *
+* Input:    - its answer to *idn?                       *
+* Return:   pointer into models[]; the last entry if    *
+*           the model is not known                      *
+********************************************************/
+const struct model *model_find (const char *idn)
+{
+const struct model *m;
+
+for (m = models; m->id[0]; m++)
+    if (strstr (idn, "KEITHLEY") && strstr (idn, m->id))
+        break;
+return m;
+}
+
+
+/********************************************************
+* plan_load: Reads an acquisition plan: one step per    *
+*            line, "mode dt minutes [settle tol sec]",  *
+*            '#' starts a comment.                      *
+* Input:    - file name                                 *
+* Return:   1 if OK, 0 if error                         *
+* Note:     mode as -m, or its name (dcv, dca, ohm,     *
+*           temp, cont, diode, or as in SCPI); dt as -t.*
+********************************************************/
+int plan_load (const char *name)
+{
+static const char *alias[] = {"dcv", "dca", "ohm", "temp", "cont", "diode"};
+FILE    *fp;
+char    line[256], w[7][32], *p, *e[5];
+long    i;
+int     n = 0, k;
+
+if (NULL == (fp = fopen (name, "rt")))
+    {
+    fprintf(stderr, "Could not open plan '%s'.\n", name);
+    return 0;
+    }
+while (fgets (line, sizeof(line), fp))
+    {
+    n++;
+    if (NULL != (p = strchr (line, '#')))
+        *p = 0;
+    k = sscanf (line, "%31s %31s %31s %31s %31s %31s %31s", w[0], w[1], w[2], w[3], w[4], w[5],
+                w[6]);
+    if (k < 1)
+        continue;                   /* empty */
+    if (nstep == MAXSTEP)
+        {
+        fprintf(stderr, "%s:%d: more than %d steps.\n", name, n, MAXSTEP);
+        fclose (fp);
+        return 0;
+        }
+
+    /* every word must be used up: "2x" or "2.5" is no mode */
+    for (p = w[0]; *p; p++)
+        *p = tolower (*p);
+    for (i = 0; i < 6 && strcmp (w[0], alias[i]) && strcmp (w[0], scpi_mode[i]); i++)
+        ;
+    if (i == 6)
+        i = strtol (w[0], &e[0], 10);
+    else
+        e[0] = w[0] + strlen (w[0]);
+    plan[nstep].mode = i;
+    plan[nstep].dt = strtol (w[1], &e[1], 10);
+    plan[nstep].minutes = strtod (w[2], &e[2]);
+    plan[nstep].tol = plan[nstep].settle = 0.0;
+    e[3] = e[4] = "";
+    if (k == 6)
+        {
+        plan[nstep].tol = strtod (w[4], &e[3]);
+        plan[nstep].settle = strtod (w[5], &e[4]);
+        }
+    if ((k != 3 && k != 6) || *e[0] || e[0] == w[0] || *e[1] || e[1] == w[1] ||
+        *e[2] || e[2] == w[2] || *e[3] || *e[4] || i < 0 || i > 5 ||
+        plan[nstep].dt < 0 || plan[nstep].dt > 600 || plan[nstep].minutes <= 0.0 ||
+        (k == 6 && (strcmp (w[3], "settle") || e[3] == w[4] || e[4] == w[5] ||
+        plan[nstep].tol < 0.0 || plan[nstep].settle <= 0.0)))
+        {
+        fprintf(stderr, "%s:%d: expected 'mode dt minutes [settle tol sec]'.\n", name, n);
+        fclose (fp);
+        return 0;
+        }
+    nstep++;
+    }
+fclose (fp);
+if (!nstep)
+    fprintf(stderr, "Plan '%s' has no steps.\n", name);
+return nstep > 0;
+}
+
+
+/* a step of the plan, in words */
+void step_text (char *buf, int len, int k)
+{
+int     n;
+
+n = snprintf (buf, len, "mode %s, interval %.1f s, %g min", scpi_mode[plan[k].mode],
+              plan[k].dt / 10.0, plan[k].minutes);
+if (plan[k].settle > 0.0 && n < len)
+    snprintf (buf + n, len - n, " or until within %g for %g s", plan[k].tol, plan[k].settle);
+}
+
+
+/********************************************************
+* burst_len: Readings per trigger: as fast as possible, *
+*            bursts into the buffer, if there is one.   *
+* Input:    - model                                     *
+*           - interval (0.1 s) and mode                 *
+* Return:   readings per trigger, 1 if no bursts        *
+********************************************************/
+int burst_len (const struct model *m, int dt, int mode)
+{
+unsigned long long ns;
+int     n;
+
+if (dt > 0 || m->buffer <= 0)
+    return 1;
+ns = scpi_plc[mode] * 3 * PLC_NS;
+if (ns < 1000000000ULL / m->rate)
+    ns = 1000000000ULL / m->rate;
+n = BURST_NS / ns;
+if (n > BURST_MAX)
+    n = BURST_MAX;
+if (n > m->buffer)
+    n = m->buffer;
+return (n < 1) ? 1 : n;
+}
+
+
+/********************************************************
+* inst_recover: Tries to get going again after a bus    *
+*               error: device clear (or reopen the      *
+*               device) and set it up again, with       *
+*               exponential backoff between attempts.   *
+* Input:    - pointer to instrument ID, may be changed  *
+*           - data file, gets a gap marker              *
+*           - acquisition start, s since the Epoch      *
+*           - what went wrong                           *
+* Return:   1 if OK, 0 if given up                      *
+********************************************************/
+int inst_recover (int *dvm, FILE *outfile, double t0, const char *what)
+{
+unsigned long long ns = clock_ns(), wait = 500000000ULL;
+double  start = timeinfo();
+int     k;
+
+if (bus_eof || cfg.retries < 1)
+    return 0;
+fprintf(stderr, "\nBus error (%s), trying to recover.\n", what);
+for (k = 1; k <= cfg.retries; k++)
+    {
+    if (bus_clear (*dvm) & ERR)     /* device not responding: start afresh */
+        {
+        bus_close (*dvm);
+        *dvm = bus_dev (0, cfg.pad, 0, T1s, 1, 0);
+        }
+    if (*dvm >= 0)
+        bus_timeout (*dvm, cfg.timeout ? cfg.timeout : 1000000000ULL);
+    if (*dvm >= 0 && inst_setup (*dvm))
+        {
+        ns = clock_ns() - ns;
+        fprintf(outfile, "# Gap: %.4f ... %.4f min, %s, recovered after %d attempt(s)\n",
+                (start - t0) / 60.0, (timeinfo() - t0) / 60.0, what, k);
+        fprintf(stderr, "Recovered after %.3f s.\n", ns / 1e9);
+        stats_begin (&stats);
+        stats.recoveries++;
+        stats.recovery_ns += ns;
+        stats_end (&stats);
+        return 1;
+        }
+    if (k < cfg.retries)
+        {
+        fprintf(stderr, "Attempt %d of %d failed, next one in %.1f s.\n",
+                k, cfg.retries, wait / 1e9);
+        clock_sleep (wait);
+        if (wait < 32000000000ULL)
+            wait *= 2;
+        }
+    }
+fprintf(stderr, "Giving up after %d attempts.\n", cfg.retries);
+return 0;
+}
+
+
+/********************************************************
+* inst_errors: Serial poll; if the instrument has       *
+*              errors queued, reads them all and logs   *
+*              them to the data file and to stderr.     *
+* Input:    - instrument ID                             *
+*           - data file                                 *
+*           - acquisition start, s since the Epoch      *
+* Return:   number of errors read                       *
+* Note:     "*sre 4" has the instrument request service *
+*           when its error queue becomes non-empty, so  *
+*           the loop calls this only upon SRQ. Another  *
+*           device may assert SRQ as well; the poll is  *
+*           cheap enough not to care.                   *
+********************************************************/
+int inst_errors (const int dvm, FILE *outfile, double t0)
+{
+char    buffer[MAXLEN], stb = 0;
+int     k, n = 0;
+
+if ((bus_spoll (dvm, &stb) & ERR) || !(stb & 0x04))    /* EAV: error available */
+    return 0;
+for (k = 0; k < 20; k++)            /* the queue holds 10, plus a few new ones */
+    {
+    if (!inst_write (dvm, ":syst:err?") || (bus_read (dvm, buffer, MAXLEN-1) & ERR) || !bus_cnt)
+        break;
+    buffer[bus_cnt] = 0x0;
+    strclean (buffer);              /* remove the CRLF */
+    if (atoi (buffer) == 0)         /* '0,"No error"': queue is empty */
+        break;
+    fprintf(outfile, "# Instrument error: %.4f min, %s\n", (timeinfo() - t0) / 60.0, buffer);
+    fprintf(stderr, "\nInstrument error: %s\n", buffer);
+    n++;
+    }
+stats_begin (&stats);
+stats.inst_errors += n;
+stats_end (&stats);
+return n;
+}
+
+
+/********************************************************
+* TIMING_REPORT: Prints rate and latency quantiles.     *
+* Input:    - file to print to                          *
+*           - line prefix (e.g. "# " for data file)     *
+*           - number of samples                         *
+*           - duration in minutes                       *
+* Return:   Nothing.                                    *
+********************************************************/
+void timing_report (FILE *fp, const char *prefix, unsigned long n, double minutes)
+{
+fprintf(fp, "%sSamples: %lu in %.4f min, %.3f samples/s\n", prefix, n, minutes,
+        minutes > 0.0 ? n / (minutes * 60.0) : 0.0);
+if (n)
+    fprintf(fp, "%sTime to first sample: %.1f ms\n", prefix, stats.first_ns / 1e6);
+hist_print (fp, prefix, "loop period", &stats.period);
+hist_print (fp, prefix, "bus round trip", &stats.bus);
+hist_print (fp, prefix, "sample to file", &stats.disk);
+if (stats.overruns)
+    fprintf(fp, "%sOverruns: %llu (sampling interval too short)\n", prefix, stats.overruns);
+if (stats.recoveries)
+    fprintf(fp, "%sRecoveries: %llu, %.3f s lost\n", prefix, stats.recoveries,
+            stats.recovery_ns / 1e9);
+if (stats.inst_errors)
+    fprintf(fp, "%sInstrument errors: %llu\n", prefix, stats.inst_errors);
+if (dead.count)
+    hist_print (fp, prefix, "dead time at steps", &dead);
+fprintf(fp, "%sI/O timeout: %g ms (%s)\n", prefix, bus_timeout_ns() / 1e6,
+        cfg.timeout ? "fixed" : "adaptive");
+dog_report (fp, prefix);
+}
+
+
+/********************************************************
+* BENCH_REPORT: Appends the results of a run as one     *
+*               line of JSON to a file.                 *
+* Input:    - file name                                 *
+*           - JSON members describing the setup         *
+*           - number of samples                         *
+*           - duration and CPU time in seconds          *
+* Return:   Nothing.                                    *
+********************************************************/
+void bench_report (const char *name, const char *setup, unsigned long n, double sec, double cpu)
+{
+static const double q[] = {0.5, 0.9, 0.99, 0.999};
+const struct hist *h[] = {&stats.period, &stats.bus, &stats.disk};
+static const char *hname[] = {"period", "bus", "disk"};
+FILE    *fp;
+time_t  t;
+int     i, k;
+
+if (NULL == (fp = fopen (name, "at")))
+    {
+    fprintf(stderr, "Could not open '%s' for writing.\n", name);
+    return;
+    }
+time (&t);
+fprintf(fp, "{\"version\": \"" VERSION "\", \"time\": %ld, %s, \"samples\": %lu, "
+        "\"seconds\": %.6f, \"samples_per_s\": %.3f, \"cpu_us_per_sample\": %.3f, "
+        "\"first_sample_ms\": %.3f, \"overruns\": %llu, \"errors\": %llu",
+        (long)t, setup, n, sec, sec > 0.0 ? n / sec : 0.0, n ? cpu * 1e6 / n : 0.0,
+        stats.first_ns / 1e6, stats.overruns, stats.errors);
+for (k = 0; k < 3; k++)
+    {
+    fprintf(fp, ", \"%s_us\": {", hname[k]);
+    for (i = 0; i < 4; i++)
+        fprintf(fp, "\"p%g\": %.3f, ", q[i] * 100, hist_quantile (h[k], q[i]) / 1e3);
+    fprintf(fp, "\"max\": %.3f}", h[k]->max / 1e3);
+    }
+fprintf(fp, "}\n");
+fclose (fp);
+}
+
+
+/********************************************************
+* CPUTIME: Returns the CPU time used so far, by all     *
+*          threads of the process.                      *
+* Input:    Nothing.                                    *
+* Return:   user + system time in seconds               *
+********************************************************/
+double cputime (void)
+{
+struct rusage ru;
+
+getrusage (RUSAGE_SELF, &ru);
+return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+       + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+
+/********************************************************
+* SOAK_WINDOW: Takes stock at the end of a window of    *
+*              the soak test, starts the next one.      *
+* Input:    - samples so far                            *
+*           - data file                                 *
+* Return:   Nothing.                                    *
+********************************************************/
+void soak_window (unsigned long n, FILE *outfile)
+{
+FILE    *fp;
+long    size, pages = 0;
+double  cpu = cputime(), real = nanotime() / 1e9;
+int     k = soak.n;
+
+if (k >= SOAK_WINDOWS + 2)
+    return;
+if (NULL != (fp = fopen ("/proc/self/statm", "rt")))
+    {
+    if (2 != fscanf (fp, "%ld %ld", &size, &pages))
+        pages = 0;
+    fclose (fp);
+    }
+soak.w[k].days = (timeinfo() - stats.start) / 86400.0;
+soak.w[k].samples = n - soak.samples;
+soak.w[k].cpu_us = soak.w[k].samples ? (cpu - soak.cpu) * 1e6 / soak.w[k].samples : 0.0;
+soak.w[k].real = real - soak.real;
+soak.w[k].flush_p99 = hist_quantile (&soak.flush, 0.99) / 1e6;
+soak.w[k].flush_max = soak.flush.max / 1e6;
+soak.w[k].rss_kb = pages * (sysconf (_SC_PAGESIZE) / 1024.0);
+soak.w[k].file_mb = ftell (outfile) / 1048576.0;
+soak.n++;
+
+soak.cpu = cpu;
+soak.real = real;
+soak.samples = n;
+soak.next += soak.days * 86400.0 / SOAK_WINDOWS;
+hist_clear (&soak.flush);
+}
+
+
+/********************************************************
+* SOAK_REPORT: Prints the windows of the soak test, and *
+*              whether the cost grows with run length.  *
+* Input:    Nothing.                                    *
+* Return:   1 if it does, 0 if OK                       *
+********************************************************/
+int soak_report (void)
+{
+int     k, b, last = soak.n - 1, bad = 0;
+
+fprintf(stderr, "Soak test: %g days\n", soak.days);
+fprintf(stderr, "   day   samples  real s  CPU us/sample  flush p99/max ms   RSS kB   file MB\n");
+for (k = 0; k < soak.n; k++)
+    fprintf(stderr, "%6.2f %9lu %7.2f %14.3f %8.3f %8.3f %8.0f %9.1f\n",
+            soak.w[k].days, soak.w[k].samples, soak.w[k].real, soak.w[k].cpu_us,
+            soak.w[k].flush_p99, soak.w[k].flush_max, soak.w[k].rss_kb, soak.w[k].file_mb);
+if (soak.n < 2)
+    return 0;
+
+/* compare with the second window (the first one includes start-up),
+   the last window only if it is a full one */
+b = (soak.n > 2) ? 1 : 0;
+if (last > b && soak.w[last].samples < soak.w[b].samples / 2)
+    last--;
+if (soak.w[last].cpu_us > 2.0 * soak.w[b].cpu_us + 1.0)
+    {
+    fprintf(stderr, "Soak test: CPU time per sample grows (%.3f -> %.3f us).\n",
+            soak.w[b].cpu_us, soak.w[last].cpu_us);
+    bad = 1;
+    }
+if (soak.w[last].flush_p99 > 2.0 * soak.w[b].flush_p99 + 1.0)
+    {
+    fprintf(stderr, "Soak test: flush time grows (p99 %.3f -> %.3f ms).\n",
+            soak.w[b].flush_p99, soak.w[last].flush_p99);
+    bad = 1;
+    }
+if (soak.w[last].rss_kb > soak.w[b].rss_kb + 1024.0)
+    {
+    fprintf(stderr, "Soak test: memory grows (%.0f -> %.0f kB).\n",
+            soak.w[b].rss_kb, soak.w[last].rss_kb);
+    bad = 1;
+    }
+fprintf(stderr, "Soak test %s.\n", bad ? "FAILED" : "passed");
+return bad;
+}
+
+
 /********************************************************
 * TIMEINFO: Returns actual time elapsed since the Epoch *
 * Input:    Nothing.                                    *
 * Return:   time in microseconds                        *
-* Note:     #include <time.h>                           *
-*           #include <sys/time.h>                       *
+* Note:     runs faster during a soak test (k2kclock.c) *
 ********************************************************/
 double timeinfo (void)
 {
-struct timeval t;
+return clock_wall ();
+}
+
 
-gettimeofday(&t, NULL);
-return (double)t.tv_sec + (double)t.tv_usec/1000000.0;
+#ifdef PROBE
+/********************************************************
+* PROBE_REPORT: Prints the time spent in each phase of  *
+*               the acquisition loop to stderr.         *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void probe_report (void)
+{
+unsigned long long total = 0;
+int i;
+
+for (i = 0; i < PH_N; i++)
+    total += probe[i].sum;
+fprintf(stderr, "\n\n      phase       count     mean/us      min/us      max/us   share\n");
+for (i = 0; i < PH_N; i++)
+    {
+    if (!probe[i].n)
+        continue;
+    fprintf(stderr, "%11s %11lu %11.1f %11.1f %11.1f %6.1f%%\n", probe_name[i], probe[i].n,
+            probe[i].sum / 1e3 / probe[i].n, probe[i].min / 1e3, probe[i].max / 1e3,
+            total ? 100.0 * probe[i].sum / total : 0.0);
+    }
 }
+#endif
 
 
 /************************************************************************
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# k2kbench.sh - runs k2000 against the simulated instrument in all
+# combinations of plot, flush, monitoring and trace settings, and
+# appends one line of JSON per run to the results file.
+#
+# Usage: k2kbench.sh [results.json]
+#
+# Environment: K2000 (program, default ./k2000), LATENCY (list of
+# simulated latencies in us, default "0 1000"), MINUTES (per run,
+# default 0.05), DT (list of -t, default "0 1": as fast as possible,
+# which reads in bursts where the model can, and one reading per
+# trigger).
+#
+# Copyright (c) 2004...2026 by Joerg Hau. GPL version 2, see LICENSE.
+
+K2000=${K2000:-./k2000}
+LATENCY=${LATENCY:-"0 1000"}
+MINUTES=${MINUTES:-0.05}
+DT=${DT:-"0 1"}
+OUT=${1:-k2kbench.json}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+GRAPH='-n ""'
+command -v gnuplot >/dev/null || GRAPH="-n"     # plot runs need gnuplot
+
+for lat in $LATENCY; do
+for dt in $DT; do
+eval "set -- $GRAPH"
+for graph; do
+for flush in 1 100; do
+for sink in "" "-M $TMP/k2000.prom -I 1" "-H $TMP/k2000.sock" "-X $TMP/k2000.trc"; do
+    echo "latency $lat us, dt $dt, flush $flush ${graph:-with plot} $sink" >&2
+    $K2000 -f -S "$lat" -t "$dt" -T "$MINUTES" -w "$flush" $graph $sink \
+           -B "$OUT" "$TMP/bench.dat" </dev/null >/dev/null 2>&1 ||
+        echo "run failed" >&2
+done
+done
+done
+done
+done
+echo "Results appended to $OUT" >&2
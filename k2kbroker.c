@@ -0,0 +1,569 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K B R O K E R . C
+
+ Shares the GPIB bus between several k2000 (or other) processes.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Two programs that open the same board each think they are alone on
+ the bus: their transactions interleave as it happens, and when both
+ talk to the same instrument, one of them gets the answer to the
+ other's question. k2kbroker is the only program that opens the
+ boards. Clients (k2000 -b) connect to its UNIX socket and send it
+ their transactions (k2kclient.c, k2kbroker.h), which it carries out
+ one at a time, through k2kbus.c like k2000 does, so -X traces all
+ of them and the watchdog of k2kdog.c guards all of them.
+
+ Which client goes next: each has a share of the bus (1 unless it
+ asks for more), and a virtual time, which advances by the bus time
+ it used divided by its share. Of the clients waiting, the one with
+ the smallest virtual time goes first; a client that was idle starts
+ at the virtual time of the last one served, so it cannot save up
+ bus time for later (start time fair queueing). So each of n busy
+ clients gets at least its share of the bus, and a client reading
+ once a second is served right after the transaction in progress,
+ even while another one reads as fast as it can.
+
+ A query and its reply go together: a write sent with BRK_HOLD keeps
+ other clients off that device until the same client's next request
+ (normally the read), or BRK_HOLD_MS at most. Other devices carry on
+ meanwhile. Looking at SRQ costs no bus traffic and is answered at
+ once, without waiting for a turn.
+
+ When a client disconnects, its devices are taken offline, and how
+ long it waited for the bus is printed.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 -pthread k2kbroker.c k2kbus.c k2ktrace.c k2ksim.c k2kclock.c \
+     k2kdog.c k2khist.c -lgpib -o k2kbroker
+
+ With -DNO_GPIB (and without -lgpib), only -S works, for tests.
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#define _GNU_SOURCE     /* accept4() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>     /* getopt() */
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "k2kbus.h"
+#include "k2kbroker.h"
+#include "k2ktrace.h"
+#include "k2kdog.h"
+#include "k2khist.h"
+
+#define ERR_FILE  4         /* error code, as k2000 */
+#define MAXCLI    16
+#define MAXH      64        /* devices open, all clients */
+#define MAXSHARE  100
+
+static struct client
+{
+    int         fd;                 /* -1: free */
+    char        name[64];
+    int         share;
+    double      vt;                 /* virtual time: bus ns / share */
+    int         pending;            /* a request is waiting in q */
+    struct brk_req q;
+    char        *data;
+    unsigned long long since;       /* ... since */
+    int         hold;               /* handle held after a query, -1 none */
+    unsigned long long hold_end;
+    unsigned long long requests, busy;
+    struct hist wait;               /* arrival to start of the transaction */
+} cli[MAXCLI];
+
+static struct
+{
+    int     owner;                  /* client, -1: free */
+    int     ud, board, pad, tmo;
+} hd[MAXH];
+
+static volatile sig_atomic_t term = 0;
+static double   vnow = 0.0;         /* virtual time of the last one served */
+static int      verbose = 0;
+static char     obuf[BRK_MAXDATA];
+static unsigned long long ns_start;
+
+static void on_signal (int sig);
+static void accept_client (int sock);
+static void take (struct client *c);
+static int  pick (unsigned long long now);
+static void serve (struct client *c);
+static void answer (struct client *c, int ret, const void *data, uint32_t len);
+static void drop (struct client *c);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kbroker [-h] [-S us] [-X file] [-W ms] [-v] socket"
+"\n        -h       this help screen"
+"\n        -S us    no bus: a simulated K2000 taking 'us' microseconds per reading"
+"\n        -X file  trace all GPIB transactions to 'file' (see k2ktrdump)"
+"\n        -W ms    IFC if a transaction hangs this long past its timeout (default 1000, 0 = off)"
+"\n        -v       verbose: tell when clients come and go\n\n";
+
+struct sockaddr_un un;
+struct sigaction sa;
+struct pollfd pfd[MAXCLI+1];
+struct client *who[MAXCLI+1];
+unsigned long long now, end;
+char    trace[128] = "";
+long    latency = -1, grace = 1000;
+int     sock, key, i, n, c, tmo;
+
+while ((key = getopt(argc, argv, "hvS:X:W:")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 'v':
+            verbose = 1;
+            continue;
+        case 'S':
+            sscanf (optarg, "%9ld", &latency);
+            if (latency < 0)
+                {
+                puts("Error: latency must be positive.");
+                return 1;
+                }
+            continue;
+        case 'X':
+            sscanf (optarg, "%120s", trace);
+            continue;
+        case 'W':
+            sscanf (optarg, "%9ld", &grace);
+            if (grace < 0)
+                {
+                puts("Error: watchdog time must be positive.");
+                return 1;
+                }
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+if (argv[optind] == NULL)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify the socket.\n");
+    return 1;
+    }
+if (strlen (argv[optind]) >= sizeof(un.sun_path))
+    {
+    fprintf(stderr, "Socket path '%s' is too long.\n", argv[optind]);
+    return 1;
+    }
+
+if (latency >= 0)
+    bus_simulate (latency);
+if (trace[0])
+    {
+    if (!trace_start (trace, TRACE_DATA))
+        return ERR_FILE;
+    atexit (trace_stop);
+    }
+if (grace > 0 && dog_start (0, grace * 1000000ULL))
+    atexit (dog_stop);
+
+memset (&un, 0, sizeof(un));
+un.sun_family = AF_UNIX;
+strcpy (un.sun_path, argv[optind]);
+unlink (un.sun_path);               /* left over from an earlier run */
+if ((sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+    bind (sock, (struct sockaddr *)&un, sizeof(un)) < 0 || listen (sock, MAXCLI) < 0)
+    {
+    fprintf(stderr, "Cannot listen on '%s': %s\n", un.sun_path, strerror (errno));
+    return ERR_FILE;
+    }
+
+memset (&sa, 0, sizeof(sa));
+sa.sa_handler = on_signal;          /* no SA_RESTART: wake up poll() */
+sigemptyset (&sa.sa_mask);
+sigaction (SIGTERM, &sa, NULL);
+sigaction (SIGINT, &sa, NULL);
+signal (SIGPIPE, SIG_IGN);
+
+for (c = 0; c < MAXCLI; c++)
+    cli[c].fd = -1;
+for (i = 0; i < MAXH; i++)
+    hd[i].owner = -1;
+
+ns_start = nanotime ();
+printf("k2kbroker " VERSION ": bus '%s', listening on '%s'\n",
+       latency >= 0 ? "simulator" : "gpib", un.sun_path);
+fflush (stdout);
+
+while (!term)
+    {
+    /* listen to whoever has nothing waiting yet; requests of one client
+       come one after the other, so there is never more than one */
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    for (n = 1, c = 0; c < MAXCLI; c++)
+        if (cli[c].fd >= 0 && !cli[c].pending)
+            {
+            pfd[n].fd = cli[c].fd;
+            pfd[n].events = POLLIN;
+            who[n++] = &cli[c];
+            }
+
+    now = nanotime ();
+    tmo = -1;                       /* nothing to do: wait */
+    if (pick (now) >= 0)
+        tmo = 0;                    /* only look, then go on */
+    else
+        for (c = 0; c < MAXCLI; c++)    /* held up by a hold: until it ends */
+            if (cli[c].fd >= 0 && cli[c].hold >= 0)
+                {
+                end = (cli[c].hold_end - now) / 1000000ULL + 1;
+                if (tmo < 0 || (int)end < tmo)
+                    tmo = (int)end;
+                }
+
+    if (poll (pfd, n, tmo) < 0 && errno != EINTR)
+        break;
+    if (pfd[0].revents & POLLIN)
+        accept_client (sock);
+    for (i = 1; i < n; i++)
+        if (pfd[i].revents)
+            take (who[i]);
+
+    if ((c = pick (nanotime ())) >= 0)
+        serve (&cli[c]);
+    }
+
+for (c = 0; c < MAXCLI; c++)
+    if (cli[c].fd >= 0)
+        drop (&cli[c]);
+close (sock);
+unlink (un.sun_path);
+printf("k2kbroker: stopped after %.1f s.\n", (nanotime () - ns_start) / 1e9);
+return 0;
+}
+
+
+/* SIGTERM, SIGINT: stop */
+static void on_signal (int sig)
+{
+(void)sig;
+term = 1;
+}
+
+
+/* takes a new client, if there is room */
+static void accept_client (int sock)
+{
+struct timeval tv = {1, 0};         /* a client sends its requests in one go */
+int     fd, c;
+
+if ((fd = accept4 (sock, NULL, NULL, SOCK_CLOEXEC)) < 0)
+    return;
+for (c = 0; c < MAXCLI && cli[c].fd >= 0; c++)
+    ;
+if (c == MAXCLI)
+    {
+    fprintf(stderr, "k2kbroker: too many clients, one refused.\n");
+    close (fd);
+    return;
+    }
+if (!cli[c].data && NULL == (cli[c].data = malloc (BRK_MAXDATA)))
+    {
+    close (fd);
+    return;
+    }
+setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+cli[c].fd = fd;
+snprintf (cli[c].name, sizeof(cli[c].name), "client %d", c);
+cli[c].share = 1;
+cli[c].vt = vnow;
+cli[c].pending = 0;
+cli[c].hold = -1;
+cli[c].requests = cli[c].busy = 0;
+hist_clear (&cli[c].wait);
+}
+
+
+/* all of 'len' bytes, or -1 */
+static int full (int fd, int write_it, void *p, size_t len)
+{
+ssize_t n;
+
+while (len > 0)
+    {
+    n = write_it ? write (fd, p, len) : read (fd, p, len);
+    if (n < 0 && errno == EINTR)
+        continue;
+    if (n <= 0)
+        return -1;
+    p = (char *)p + n;
+    len -= n;
+    }
+return 0;
+}
+
+
+/********************************************************
+* take: Reads the next request of a client.             *
+* Input:    - the client                                *
+* Return:   Nothing.                                    *
+* Note:     SRQ is answered at once; the others wait    *
+*           for their turn, see pick().                 *
+********************************************************/
+static void take (struct client *c)
+{
+int     srq;
+
+if (full (c->fd, 0, &c->q, sizeof(c->q)) || c->q.len > BRK_MAXDATA ||
+    full (c->fd, 0, c->data, c->q.len))
+    {
+    drop (c);                       /* gone, or talking nonsense */
+    return;
+    }
+if ((c->q.op & 0xff) == BRK_SRQ)
+    {
+    srq = bus_srq (c->q.a[0]);
+    bus_cnt = bus_err = 0;
+    answer (c, srq, NULL, 0);
+    return;
+    }
+c->since = nanotime ();
+c->pending = 1;
+if (c->vt < vnow)                   /* was idle: no credit for that */
+    c->vt = vnow;
+}
+
+
+/* the device a request is for, or NULL */
+static int handle_of (const struct client *c)
+{
+int     h = c->q.h;
+
+switch (c->q.op & 0xff)
+    {
+    case BRK_WRITE:
+    case BRK_READ:
+    case BRK_CLEAR:
+    case BRK_CLOSE:
+    case BRK_TMO:
+    case BRK_SPOLL:
+        if (h >= 0 && h < MAXH && hd[h].owner == c - cli)
+            return h;
+    }
+return -1;
+}
+
+
+/********************************************************
+* pick: Chooses the client to go next.                  *
+* Input:    - current time                              *
+* Return:   index into cli[], -1 if none can go now     *
+* Note:     Ends holds that have run out.               *
+********************************************************/
+static int pick (unsigned long long now)
+{
+int     c, o, h, best = -1;
+
+for (c = 0; c < MAXCLI; c++)
+    if (cli[c].fd >= 0 && cli[c].hold >= 0 && now >= cli[c].hold_end)
+        cli[c].hold = -1;
+
+for (c = 0; c < MAXCLI; c++)
+    {
+    if (cli[c].fd < 0 || !cli[c].pending)
+        continue;
+    if ((h = handle_of (&cli[c])) >= 0)     /* device held by another one? */
+        {
+        for (o = 0; o < MAXCLI; o++)
+            if (o != c && cli[o].fd >= 0 && cli[o].hold >= 0 &&
+                hd[cli[o].hold].board == hd[h].board && hd[cli[o].hold].pad == hd[h].pad)
+                break;
+        if (o < MAXCLI)
+            continue;
+        }
+    if (best < 0 || cli[c].vt < cli[best].vt)
+        best = c;
+    }
+return best;
+}
+
+
+/********************************************************
+* serve: Carries out the request of a client on the     *
+*        bus, and answers it.                           *
+* Input:    - the client                                *
+* Return:   Nothing.                                    *
+********************************************************/
+static void serve (struct client *c)
+{
+struct brk_req *q = &c->q;
+int32_t pads[32];
+unsigned long long t, ns;
+uint32_t len = 0;
+const void *data = NULL;
+char    stb;
+int     h, ret = ERR, i;
+
+c->pending = 0;
+c->hold = -1;                       /* any request ends a hold */
+vnow = c->vt;
+t = nanotime ();
+hist_add (&c->wait, t - c->since);
+bus_cnt = 0;
+bus_err = EARG;                     /* unless it is done below */
+
+h = handle_of (c);
+if (h >= 0 && hd[h].tmo)            /* the one this client wants */
+    bus_timeout (hd[h].ud, bus_tmo_ns (hd[h].tmo));
+
+switch (q->op & 0xff)
+    {
+    case BRK_HELLO:
+        snprintf (c->name, sizeof(c->name), "%.*s", (int)q->len, c->data);
+        c->share = (q->a[0] < 1) ? 1 : (q->a[0] > MAXSHARE) ? MAXSHARE : q->a[0];
+        if (verbose)
+            printf("k2kbroker: '%s' connected, share %d\n", c->name, c->share);
+        ret = bus_err = 0;
+        break;
+    case BRK_DEV:
+        for (h = 0; h < MAXH && hd[h].owner >= 0; h++)
+            ;
+        if (h == MAXH)
+            {
+            ret = -1;
+            break;
+            }
+        if ((ret = bus_dev (q->a[0], q->a[1], q->a[2], q->a[3], q->a[4], q->a[5])) < 0)
+            break;
+        hd[h].owner = c - cli;
+        hd[h].ud = ret;
+        hd[h].board = q->a[0];
+        hd[h].pad = q->a[1];
+        hd[h].tmo = q->a[3];
+        ret = h;
+        break;
+    case BRK_WRITE:
+        if (h >= 0)
+            ret = bus_write (hd[h].ud, c->data, q->len);
+        break;
+    case BRK_READ:
+        if (h < 0)
+            break;
+        ret = bus_read (hd[h].ud, obuf, (q->a[0] > 0 && q->a[0] < BRK_MAXDATA) ? q->a[0] : BRK_MAXDATA);
+        data = obuf;
+        len = (bus_cnt > 0) ? bus_cnt : 0;
+        break;
+    case BRK_CLEAR:
+        if (h >= 0)
+            ret = bus_clear (hd[h].ud);
+        break;
+    case BRK_CLOSE:
+        if (h < 0)
+            break;
+        ret = bus_close (hd[h].ud);
+        hd[h].owner = -1;
+        break;
+    case BRK_TMO:
+        if (h < 0)
+            break;
+        ret = bus_timeout (hd[h].ud, bus_tmo_ns (q->a[0]));
+        if (!(ret & ERR))
+            hd[h].tmo = q->a[0];
+        break;
+    case BRK_SPOLL:
+        if (h < 0)
+            break;
+        ret = bus_spoll (hd[h].ud, &stb);
+        data = &stb;
+        len = 1;
+        break;
+    case BRK_FIND:
+        i = (q->a[1] > 0 && q->a[1] < 32) ? q->a[1] : 32;
+        ret = bus_find (q->a[0], pads, i);
+        bus_cnt = bus_err = 0;
+        data = pads;
+        len = (ret > 0) ? ret * sizeof(pads[0]) : 0;
+        break;
+    }
+
+ns = nanotime () - t;
+c->requests++;
+c->busy += ns;
+c->vt += (double)ns / c->share;
+if ((q->op & BRK_HOLD) && h >= 0 && !(ret & ERR))
+    {
+    c->hold = h;
+    c->hold_end = nanotime () + BRK_HOLD_MS * 1000000ULL;
+    }
+answer (c, ret, data, len);
+}
+
+
+/* sends the answer; a client that does not take it is dropped */
+static void answer (struct client *c, int ret, const void *data, uint32_t len)
+{
+struct brk_ans a;
+
+a.ret = ret;
+a.cnt = bus_cnt;
+a.err = bus_err;
+a.len = len;
+if (full (c->fd, 1, &a, sizeof(a)) || (len && full (c->fd, 1, (void *)data, len)))
+    drop (c);
+}
+
+
+/********************************************************
+* drop: Says goodbye to a client: takes its devices     *
+*       offline, and prints how it fared.               *
+* Input:    - the client                                *
+* Return:   Nothing.                                    *
+********************************************************/
+static void drop (struct client *c)
+{
+unsigned long long up = nanotime () - ns_start;
+int     h;
+
+for (h = 0; h < MAXH; h++)
+    if (hd[h].owner == c - cli)
+        {
+        bus_close (hd[h].ud);
+        hd[h].owner = -1;
+        }
+close (c->fd);
+c->fd = -1;
+c->pending = 0;
+c->hold = -1;
+if (!c->requests)
+    return;
+printf("k2kbroker: '%s' gone: %llu requests, bus %.3f s (%.1f %% of the time)\n",
+       c->name, c->requests, c->busy / 1e9, up ? 100.0 * c->busy / up : 0.0);
+hist_print (stdout, "  ", "wait for the bus", &c->wait);
+fflush (stdout);
+}
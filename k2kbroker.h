@@ -0,0 +1,60 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K B R O K E R . H
+
+ What k2kbroker and its clients say to each other.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KBROKER_H
+#define K2KBROKER_H
+
+#include <stdint.h>
+
+/* --- one request: the header, then 'len' bytes of data (what is to be
+       written, or the name of the client). One answer to each: the
+       header, then 'len' bytes (what was read, or the addresses found).
+       Both ends are on the same machine: native byte order. --- */
+
+#define BRK_HELLO   1       /* a[0]: share of the bus; data: name */
+#define BRK_DEV     2       /* a[0..5]: as ibdev(); answer: handle */
+#define BRK_WRITE   3
+#define BRK_READ    4       /* a[0]: size of the buffer */
+#define BRK_CLEAR   5
+#define BRK_CLOSE   6
+#define BRK_TMO     7       /* a[0]: timeout, T10us ... T1000s */
+#define BRK_SPOLL   8       /* answer: the status byte as data */
+#define BRK_SRQ     9       /* a[0]: board; answer: 1 if SRQ is set */
+#define BRK_FIND    10      /* a[0]: board, a[1]: max; answer: int32 pads */
+
+#define BRK_HOLD    0x100   /* or'ed to op: nobody else talks to this
+                               device until my next request */
+
+#define BRK_MAXDATA 65536   /* per request or answer */
+#define BRK_HOLD_MS 1000    /* a hold is dropped after this long */
+
+struct brk_req
+{
+    uint32_t    op;
+    int32_t     h;          /* handle from BRK_DEV */
+    int32_t     a[6];
+    uint32_t    len;
+};
+
+struct brk_ans
+{
+    int32_t     ret;        /* status word, handle, or count */
+    int32_t     cnt;        /* bus_cnt */
+    int32_t     err;        /* bus_err */
+    uint32_t    len;
+};
+
+#endif
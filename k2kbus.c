@@ -0,0 +1,524 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K B U S . C
+
+ All GPIB I/O of k2000 goes through here.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ The functions behave like their linux-gpib counterparts ibdev(),
+ ibwrt() and ibrd(): they return the status word, and leave the byte
+ count and error code in bus_cnt and bus_err. In addition, every
+ transaction is recorded if a trace is running (k2ktrace.c).
+
+ Where the transactions go is up to the transport chosen with
+ bus_use(): linux-gpib (the default), a recorded session played back
+ (k2kreplay.c), a simulated instrument (k2ksim.c), or k2kbroker, which
+ shares the bus with other programs (k2kclient.c). Compiled with
+ -DNO_GPIB, linux-gpib is not needed, and only the latter three work.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "k2kbus.h"
+#include "k2ktrace.h"
+#include "k2khist.h"
+
+int     bus_cnt = 0;
+int     bus_err = 0;
+int     bus_eof = 0;
+
+int     bus_watched = 0;
+atomic_ullong bus_since = 0;
+atomic_ullong bus_ended = 0;
+
+/* --- for the watchdog: is a transaction hanging? --- */
+
+static inline void busy (void)
+{
+if (bus_watched)
+    atomic_store_explicit (&bus_since, nanotime(), memory_order_release);
+}
+
+static inline void idle (void)
+{
+if (bus_watched)
+    {
+    atomic_store_explicit (&bus_ended, nanotime(), memory_order_relaxed);
+    atomic_store_explicit (&bus_since, 0, memory_order_release);
+    }
+}
+
+/* --- the real thing: linux-gpib --- */
+
+#ifndef NO_GPIB
+static int gpib_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+int     ud = ibdev (board, pad, sad, tmo, eot, eos);
+
+bus_cnt = 0;
+bus_err = (ud < 0) ? iberr : 0;
+return ud;
+}
+
+static int gpib_write (int ud, const char *buf, long len)
+{
+int     sta = ibwrt (ud, buf, len);
+
+bus_cnt = ibcnt;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_read (int ud, char *buf, long len)
+{
+int     sta = ibrd (ud, buf, len);
+
+bus_cnt = ibcnt;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_clear (int ud)
+{
+int     sta = ibclr (ud);
+
+bus_cnt = 0;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_close (int ud)
+{
+int     sta = ibonl (ud, 0);
+
+bus_cnt = 0;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_tmo (int ud, int tmo)
+{
+int     sta = ibtmo (ud, tmo);
+
+bus_cnt = 0;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_ifc (int board)
+{
+SendIFC (board);
+return ibsta;
+}
+
+static int gpib_spoll (int ud, char *stb)
+{
+int     sta = ibrsp (ud, stb);
+
+bus_cnt = 0;
+bus_err = (sta & ERR) ? iberr : 0;
+return sta;
+}
+
+static int gpib_srq (int board)
+{
+short   lines = 0;
+
+if (iblines (board, &lines) & ERR)
+    return 0;
+return (lines & ValidSRQ) && (lines & BusSRQ);
+}
+
+static int gpib_find (int board, int *pads, int max)
+{
+Addr4882_t list[31], found[31];
+int     i, n;
+
+for (i = 0; i < 30; i++)
+    list[i] = MakeAddr (i + 1, 0);
+list[30] = NOADDR;
+SendIFC (board);                    /* make us controller in charge */
+if (ibsta & ERR)
+    return -1;
+FindLstn (board, list, found, 31);
+if (ibsta & ERR)
+    return -1;
+for (n = 0; n < ibcnt && n < max; n++)
+    pads[n] = found[n] & 0xff;
+return n;
+}
+#else
+static int gpib_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+fprintf(stderr, "Compiled without GPIB support (NO_GPIB).\n");
+bus_cnt = 0;
+bus_err = ENOL;
+return -1;
+}
+
+static int gpib_write (int ud, const char *buf, long len)
+{
+bus_cnt = 0;
+bus_err = ENOL;
+return ERR;
+}
+
+static int gpib_read (int ud, char *buf, long len)
+{
+return gpib_write (ud, buf, len);
+}
+
+static int gpib_clear (int ud)
+{
+return gpib_write (ud, NULL, 0);
+}
+
+static int gpib_close (int ud)
+{
+return gpib_write (ud, NULL, 0);
+}
+
+static int gpib_tmo (int ud, int tmo)
+{
+return gpib_write (ud, NULL, 0);
+}
+
+static int gpib_ifc (int board)
+{
+return ERR;
+}
+
+static int gpib_spoll (int ud, char *stb)
+{
+*stb = 0;
+return gpib_write (ud, NULL, 0);
+}
+
+static int gpib_srq (int board)
+{
+return 0;
+}
+
+static int gpib_find (int board, int *pads, int max)
+{
+return -1;
+}
+#endif
+
+static const struct bus_ops gpib_ops =
+    {"gpib", gpib_dev, gpib_write, gpib_read, gpib_clear, gpib_close, gpib_tmo,
+     gpib_ifc, gpib_spoll, gpib_srq, gpib_find};
+static const struct bus_ops *ops = &gpib_ops;
+
+/* --- the timeouts linux-gpib knows (T10us ... T1000s), in ns --- */
+
+static const unsigned long long tmo_ns[] =
+{
+    0ULL,                   10000ULL,           30000ULL,           100000ULL,
+    300000ULL,              1000000ULL,         3000000ULL,         10000000ULL,
+    30000000ULL,            100000000ULL,       300000000ULL,       1000000000ULL,
+    3000000000ULL,          10000000000ULL,     30000000000ULL,     100000000000ULL,
+    300000000000ULL,        1000000000000ULL
+};
+
+#define TMO_MAX     17
+static atomic_int tmo_now = 0;  /* set for the device, 0 if unknown; read
+                                   by the watchdog thread */
+static int  tmo_ud = -1;        /* ... that device */
+
+
+/********************************************************
+* bus_use: Selects the transport.                       *
+* Input:    - transport, NULL for linux-gpib            *
+* Return:   Nothing.                                    *
+********************************************************/
+void bus_use (const struct bus_ops *o)
+{
+ops = o ? o : &gpib_ops;
+}
+
+
+/********************************************************
+* bus_dev: Opens a device, see ibdev().                 *
+* Input:    - board, primary and secondary address,     *
+*             timeout, EOI and EOS mode                 *
+* Return:   unit descriptor, negative if error          *
+********************************************************/
+int bus_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+unsigned long long t = trace_active ? nanotime() : 0;
+int     ud;
+
+busy ();
+ud = ops->dev (board, pad, sad, tmo, eot, eos);
+idle ();
+atomic_store_explicit (&tmo_now, (ud < 0) ? 0 : tmo, memory_order_relaxed);
+tmo_ud = ud;
+if (trace_active)
+    trace_add (TR_DEV, ud < 0 ? 0xff : ud, t, nanotime(), ud < 0 ? ERR : 0,
+               ud < 0 ? bus_err : -1, 0, (uint32_t)pad, NULL, 0);
+return ud;
+}
+
+
+/********************************************************
+* bus_write: Sends data to a device, see ibwrt().       *
+* Input:    - unit descriptor                           *
+*           - data and its length                       *
+* Return:   status word                                 *
+********************************************************/
+int bus_write (int ud, const char *buf, long len)
+{
+unsigned long long t = trace_active ? nanotime() : 0;
+int     sta;
+
+busy ();
+sta = ops->write (ud, buf, len);
+idle ();
+if (trace_active)
+    trace_add (TR_WRITE, ud, t, nanotime(), sta, (sta & ERR) ? bus_err : -1,
+               bus_cnt, 0, buf, len);
+return sta;
+}
+
+
+/********************************************************
+* bus_read: Reads data from a device, see ibrd().       *
+* Input:    - unit descriptor                           *
+*           - buffer and its size                       *
+* Return:   status word                                 *
+********************************************************/
+int bus_read (int ud, char *buf, long len)
+{
+unsigned long long t = trace_active ? nanotime() : 0;
+int     sta;
+
+busy ();
+sta = ops->read (ud, buf, len);
+idle ();
+if (trace_active)
+    trace_add (TR_READ, ud, t, nanotime(), sta, (sta & ERR) ? bus_err : -1,
+               bus_cnt, (uint32_t)len,
+               (trace_flags & TRACE_DATA) ? buf : NULL, bus_cnt);
+return sta;
+}
+
+
+/********************************************************
+* bus_clear: Sends Selected Device Clear, see ibclr().  *
+* Input:    - unit descriptor                           *
+* Return:   status word                                 *
+********************************************************/
+int bus_clear (int ud)
+{
+unsigned long long t = trace_active ? nanotime() : 0;
+int     sta;
+
+busy ();
+sta = ops->clear (ud);
+idle ();
+if (trace_active)
+    trace_add (TR_CLEAR, ud, t, nanotime(), sta, (sta & ERR) ? bus_err : -1,
+               0, 0, NULL, 0);
+return sta;
+}
+
+
+/********************************************************
+* bus_close: Takes a device offline, see ibonl().       *
+* Input:    - unit descriptor                           *
+* Return:   status word                                 *
+********************************************************/
+int bus_close (int ud)
+{
+return ops->close (ud);
+}
+
+
+/********************************************************
+* bus_timeout: Sets the I/O timeout of a device, if it  *
+*              is not set already, see ibtmo().         *
+* Input:    - unit descriptor                           *
+*           - timeout in ns, rounded up to the next     *
+*             value linux-gpib knows (10 us...1000 s)   *
+* Return:   status word                                 *
+********************************************************/
+int bus_timeout (int ud, unsigned long long ns)
+{
+unsigned long long t;
+int     tmo = 1, sta;
+
+while (tmo < TMO_MAX && tmo_ns[tmo] < ns)
+    tmo++;
+if (tmo == atomic_load_explicit (&tmo_now, memory_order_relaxed) && ud == tmo_ud)
+    return CMPL;
+
+t = trace_active ? nanotime() : 0;
+sta = ops->tmo (ud, tmo);
+atomic_store_explicit (&tmo_now, (sta & ERR) ? 0 : tmo, memory_order_relaxed);
+tmo_ud = ud;
+if (trace_active)
+    trace_add (TR_TMO, ud, t, nanotime(), sta, (sta & ERR) ? bus_err : -1,
+               0, (uint32_t)tmo, NULL, 0);
+return sta;
+}
+
+
+/* the timeout in force, in ns; 0 if unknown */
+unsigned long long bus_timeout_ns (void)
+{
+return tmo_ns[atomic_load_explicit (&tmo_now, memory_order_relaxed)];
+}
+
+
+/* a timeout of linux-gpib (T10us ... T1000s) in ns; 0 if none */
+unsigned long long bus_tmo_ns (int tmo)
+{
+return (tmo > 0 && tmo <= TMO_MAX) ? tmo_ns[tmo] : 0;
+}
+
+
+/********************************************************
+* bus_rtt_add: Adds a round trip to the estimate.       *
+* Input:    - pointer to estimate, zeroed at start      *
+*           - round trip in ns                          *
+* Return:   Nothing.                                    *
+* Note:     Smoothing as for TCP (RFC 6298), plus a     *
+*           maximum that decays by 1/1000 per sample.   *
+********************************************************/
+void bus_rtt_add (struct bus_rtt *e, unsigned long long ns)
+{
+double  d = (double)ns;
+
+if (!e->n++)
+    {
+    e->srtt = d;
+    e->rttvar = d / 2;
+    }
+else
+    {
+    e->rttvar += ((d > e->srtt ? d - e->srtt : e->srtt - d) - e->rttvar) / 4;
+    e->srtt += (d - e->srtt) / 8;
+    }
+e->peak *= 0.999;
+if (d > e->peak)
+    e->peak = d;
+}
+
+
+/********************************************************
+* bus_rtt_backoff: Makes the estimate more patient,     *
+*                  after a timeout.                     *
+* Input:    - pointer to estimate                       *
+* Return:   Nothing.                                    *
+********************************************************/
+void bus_rtt_backoff (struct bus_rtt *e)
+{
+if (bus_timeout_ns () > e->peak)
+    e->peak = bus_timeout_ns ();
+e->peak *= 2;
+}
+
+
+/********************************************************
+* bus_rtt_timeout: Proposes a timeout.                  *
+* Input:    - pointer to estimate                       *
+*           - time the transaction should take, as far  *
+*             as known beforehand (ns)                  *
+* Return:   timeout in ns                               *
+* Note:     1 s until there are a few round trips to    *
+*           go by, then well above the slowest one      *
+*           seen recently, but no more than that.       *
+********************************************************/
+unsigned long long bus_rtt_timeout (const struct bus_rtt *e, unsigned long long expected)
+{
+double  t;
+
+if (e->n < 8)
+    return expected > 1000000000ULL ? expected : 1000000000ULL;
+t = e->srtt + 4 * e->rttvar;
+if (t < 1.5 * e->peak)
+    t = 1.5 * e->peak;
+if (t < expected)
+    t = expected;
+return (unsigned long long)t + 2000000ULL;     /* plus 2 ms for the scheduler */
+}
+
+
+/********************************************************
+* bus_ifc: Sends Interface Clear, see SendIFC().        *
+* Input:    - board index                               *
+* Return:   status word                                 *
+* Note:     For the watchdog thread: a transaction      *
+*           hanging in the other thread is aborted.     *
+*           Not traced, and bus_cnt and bus_err are     *
+*           left alone: they belong to the other one.   *
+********************************************************/
+int bus_ifc (int board)
+{
+return ops->ifc (board);
+}
+
+
+/********************************************************
+* bus_spoll: Serial poll, see ibrsp().                  *
+* Input:    - unit descriptor                           *
+*           - where to store the status byte            *
+* Return:   status word                                 *
+********************************************************/
+int bus_spoll (int ud, char *stb)
+{
+unsigned long long t = trace_active ? nanotime() : 0;
+int     sta;
+
+busy ();
+sta = ops->spoll (ud, stb);
+idle ();
+if (trace_active)
+    trace_add (TR_SPOLL, ud, t, nanotime(), sta, (sta & ERR) ? bus_err : -1,
+               0, (uint8_t)*stb, NULL, 0);
+return sta;
+}
+
+
+/********************************************************
+* bus_srq: Looks whether a device requests service.     *
+* Input:    - board index                               *
+* Return:   1 if SRQ is asserted, 0 if not              *
+* Note:     Reads the state of the bus lines at the     *
+*           controller: costs no bus transaction.       *
+********************************************************/
+int bus_srq (int board)
+{
+return ops->srq (board);
+}
+
+
+/********************************************************
+* bus_find: Looks for listeners on a board, see         *
+*           FindLstn().                                 *
+* Input:    - board index                               *
+*           - where to store their primary addresses    *
+*           - ... and how many there is room for        *
+* Return:   number of listeners, -1 if no such board    *
+* Note:     Sends IFC first; not traced.                *
+********************************************************/
+int bus_find (int board, int *pads, int max)
+{
+return ops->find (board, pads, max);
+}
@@ -0,0 +1,96 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K B U S . H
+
+ All GPIB I/O of k2000 goes through here.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KBUS_H
+#define K2KBUS_H
+
+#ifdef NO_GPIB                 /* without linux-gpib: simulator and replay only */
+#define CMPL    0x0100          /* status bits and error codes as in linux-gpib */
+#define END     0x2000
+#define TIMO    0x4000
+#define ERR     0x8000
+#define ENOL    2
+#define EARG    4
+#define EABO    6
+#define T300ms  10
+#define T1s     11
+#define ValidSRQ 0x20
+#define BusSRQ  0x2000
+#else
+#include "gpib/ib.h"
+#endif
+
+#include <stdatomic.h>
+
+extern int  bus_cnt;    /* bytes transferred by the last call (ibcnt) */
+extern int  bus_err;    /* error code of the last call (iberr), 0 if OK */
+extern int  bus_eof;    /* replay: the recorded session is over */
+
+extern int  bus_watched;            /* keep the two below up to date */
+extern atomic_ullong bus_since;     /* nanotime() at start of the transaction
+                                       in progress, 0 if none */
+extern atomic_ullong bus_ended;     /* nanotime() at end of the last one */
+
+/* --- a transport; each function sets bus_cnt and bus_err, except
+       ifc(), which is called from another thread (k2kdog.c) --- */
+
+struct bus_ops
+{
+    const char *name;
+    int     (*dev) (int board, int pad, int sad, int tmo, int eot, int eos);
+    int     (*write) (int ud, const char *buf, long len);
+    int     (*read) (int ud, char *buf, long len);
+    int     (*clear) (int ud);
+    int     (*close) (int ud);
+    int     (*tmo) (int ud, int tmo);
+    int     (*ifc) (int board);
+    int     (*spoll) (int ud, char *stb);
+    int     (*srq) (int board);     /* 1 if SRQ is asserted; no bus traffic */
+    int     (*find) (int board, int *pads, int max);
+};
+
+/* --- running estimate of the round trip time, for the I/O timeout --- */
+
+struct bus_rtt
+{
+    double  srtt, rttvar;       /* ns: smoothed round trip, its variation */
+    double  peak;               /* ns: recent maximum, decays slowly */
+    unsigned long n;            /* round trips seen */
+};
+
+void    bus_use (const struct bus_ops *ops);
+int     bus_dev (int board, int pad, int sad, int tmo, int eot, int eos);
+int     bus_write (int ud, const char *buf, long len);
+int     bus_read (int ud, char *buf, long len);
+int     bus_clear (int ud);
+int     bus_close (int ud);
+int     bus_timeout (int ud, unsigned long long ns);
+unsigned long long bus_timeout_ns (void);
+unsigned long long bus_tmo_ns (int tmo);
+int     bus_ifc (int board);
+int     bus_spoll (int ud, char *stb);
+int     bus_srq (int board);
+int     bus_find (int board, int *pads, int max);
+
+void    bus_rtt_add (struct bus_rtt *e, unsigned long long ns);
+void    bus_rtt_backoff (struct bus_rtt *e);
+unsigned long long bus_rtt_timeout (const struct bus_rtt *e, unsigned long long expected);
+
+int     bus_replay (const char *name, int fast);    /* k2kreplay.c */
+int     bus_simulate (long latency);                /* k2ksim.c */
+int     bus_broker (const char *path, const char *name, int share);   /* k2kclient.c */
+
+#endif
@@ -0,0 +1,254 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K C L I E N T . C
+
+ Talks to the bus through k2kbroker instead of directly.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ bus_broker() makes k2kbus.c send each transaction to k2kbroker over
+ its UNIX socket, and wait for the answer: status word, byte count,
+ error code and data come back just as linux-gpib would have left
+ them. A query (a write with a '?' in it) asks the broker to hold the
+ device until the reply has been read, so no other client can get
+ between a question and its answer.
+
+ Interface Clear is not available: the broker owns the boards and
+ runs a watchdog of its own. If the broker goes away, every call fails
+ with ENOL, and k2000 stops after its recovery attempts.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "k2kbus.h"
+#include "k2kbroker.h"
+
+static int      sock = -1;
+
+static int  client_dev (int board, int pad, int sad, int tmo, int eot, int eos);
+static int  client_write (int ud, const char *buf, long len);
+static int  client_read (int ud, char *buf, long len);
+static int  client_clear (int ud);
+static int  client_close (int ud);
+static int  client_tmo (int ud, int tmo);
+static int  client_ifc (int board);
+static int  client_spoll (int ud, char *stb);
+static int  client_srq (int board);
+static int  client_find (int board, int *pads, int max);
+static int  call (uint32_t op, int h, const int32_t *a, int na, const void *data, long len,
+                  void *out, long max);
+
+static const struct bus_ops client_ops =
+    {"broker", client_dev, client_write, client_read, client_clear, client_close,
+     client_tmo, client_ifc, client_spoll, client_srq, client_find};
+
+
+/********************************************************
+* bus_broker: Connects to k2kbroker and selects it as   *
+*             transport.                                *
+* Input:    - path of the broker's socket               *
+*           - name of this client, for its statistics   *
+*           - its share of the bus (1 = as the others)  *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int bus_broker (const char *path, const char *name, int share)
+{
+struct sockaddr_un un;
+int32_t a[1] = {share};
+
+if (strlen (path) >= sizeof(un.sun_path))
+    {
+    fprintf(stderr, "Broker: socket path '%s' is too long.\n", path);
+    return 0;
+    }
+memset (&un, 0, sizeof(un));
+un.sun_family = AF_UNIX;
+strcpy (un.sun_path, path);
+if ((sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+    connect (sock, (struct sockaddr *)&un, sizeof(un)) < 0)
+    {
+    fprintf(stderr, "Broker: cannot connect to '%s': %s\n", path, strerror (errno));
+    if (sock >= 0)
+        close (sock);
+    sock = -1;
+    return 0;
+    }
+if (call (BRK_HELLO, -1, a, 1, name, strlen (name), NULL, 0) < 0)
+    {
+    fprintf(stderr, "Broker: '%s' does not answer.\n", path);
+    close (sock);
+    sock = -1;
+    return 0;
+    }
+bus_use (&client_ops);
+return 1;
+}
+
+
+/* all of 'len' bytes, or -1; a signal does not interrupt the exchange,
+   and a broker gone away gives an error rather than SIGPIPE */
+static int full (int write_it, void *p, size_t len)
+{
+ssize_t n;
+
+while (len > 0)
+    {
+    n = write_it ? send (sock, p, len, MSG_NOSIGNAL) : read (sock, p, len);
+    if (n < 0 && errno == EINTR)
+        continue;
+    if (n <= 0)
+        return -1;
+    p = (char *)p + n;
+    len -= n;
+    }
+return 0;
+}
+
+
+/********************************************************
+* call: Sends a request to the broker, waits for the    *
+*       answer.                                         *
+* Input:    - BRK_..., maybe with BRK_HOLD              *
+*           - handle                                    *
+*           - arguments, and how many                   *
+*           - data to send, and its length              *
+*           - where to store the data received, size    *
+* Return:   'ret' of the answer; -1 and bus_err = ENOL  *
+*           if the broker is gone                       *
+********************************************************/
+static int call (uint32_t op, int h, const int32_t *a, int na, const void *data, long len,
+                 void *out, long max)
+{
+struct brk_req  q;
+struct brk_ans  r;
+char    skip[256];
+size_t  n;
+
+memset (&q, 0, sizeof(q));
+q.op = op;
+q.h = h;
+if (na)
+    memcpy (q.a, a, na * sizeof(q.a[0]));
+q.len = (len < BRK_MAXDATA) ? len : BRK_MAXDATA;
+if (sock < 0 || full (1, &q, sizeof(q)) || full (1, (void *)data, q.len) ||
+    full (0, &r, sizeof(r)))
+    goto gone;
+n = (r.len < (size_t)max) ? r.len : (size_t)max;
+if (full (0, out, n))
+    goto gone;
+for (r.len -= n; r.len > 0; r.len -= n)     /* more than asked for */
+    {
+    n = (r.len < sizeof(skip)) ? r.len : sizeof(skip);
+    if (full (0, skip, n))
+        goto gone;
+    }
+bus_cnt = r.cnt;
+bus_err = r.err;
+return r.ret;
+
+gone:
+if (sock >= 0)
+    {
+    fprintf(stderr, "\nBroker: connection lost.\n");
+    close (sock);
+    sock = -1;
+    }
+bus_cnt = 0;
+bus_err = ENOL;
+return -1;
+}
+
+
+static int status (int ret)
+{
+return (ret < 0) ? ERR : ret;
+}
+
+static int client_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+int32_t a[6] = {board, pad, sad, tmo, eot, eos};
+
+return call (BRK_DEV, -1, a, 6, NULL, 0, NULL, 0);
+}
+
+static int client_write (int ud, const char *buf, long len)
+{
+uint32_t op = BRK_WRITE;
+
+if (memchr (buf, '?', len))             /* a query: keep it with its reply */
+    op |= BRK_HOLD;
+return status (call (op, ud, NULL, 0, buf, len, NULL, 0));
+}
+
+static int client_read (int ud, char *buf, long len)
+{
+int32_t a[1] = {len};
+
+return status (call (BRK_READ, ud, a, 1, NULL, 0, buf, len));
+}
+
+static int client_clear (int ud)
+{
+return status (call (BRK_CLEAR, ud, NULL, 0, NULL, 0, NULL, 0));
+}
+
+static int client_close (int ud)
+{
+return status (call (BRK_CLOSE, ud, NULL, 0, NULL, 0, NULL, 0));
+}
+
+static int client_tmo (int ud, int tmo)
+{
+int32_t a[1] = {tmo};
+
+return status (call (BRK_TMO, ud, a, 1, NULL, 0, NULL, 0));
+}
+
+static int client_ifc (int board)
+{
+return ERR;                             /* the broker's watchdog does it */
+}
+
+static int client_spoll (int ud, char *stb)
+{
+*stb = 0;
+return status (call (BRK_SPOLL, ud, NULL, 0, NULL, 0, stb, 1));
+}
+
+static int client_srq (int board)
+{
+int32_t a[1] = {board};
+
+return call (BRK_SRQ, -1, a, 1, NULL, 0, NULL, 0) > 0;
+}
+
+static int client_find (int board, int *pads, int max)
+{
+int32_t found[32], a[2] = {board, max};
+int     i, n;
+
+if (max > 32)
+    a[1] = max = 32;
+n = call (BRK_FIND, -1, a, 2, NULL, 0, found, max * sizeof(found[0]));
+for (i = 0; i < n && i < max; i++)
+    pads[i] = found[i];
+return n;
+}
@@ -0,0 +1,124 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K C L O C K . C
+
+ The clock of the acquisition: real, or running faster for soak tests.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Normally, these are just the monotonic clock, the time of day and
+ clock_nanosleep(). After clock_virtual(), waiting costs no time: the
+ clock jumps ahead instead. Everything else (the work of the program
+ itself) still takes real time. So the acquisition loop runs exactly as
+ usual, only the idle time between samples is skipped, and a week of
+ acquisition at 1 sample/s passes in seconds or minutes.
+
+ Only the thread doing the acquisition may sleep on a virtual clock;
+ reading it is fine from anywhere.
+
+*/
+
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include "k2kclock.h"
+#include "k2khist.h"
+
+static int      virtual = 0;
+static unsigned long long skipped = 0;  /* ns jumped ahead */
+static unsigned long long ns0;          /* clock_ns() at ... */
+static double   wall0;                  /* ... this time of day */
+
+
+/********************************************************
+* clock_virtual: Switches to the virtual clock.         *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void clock_virtual (void)
+{
+ns0 = clock_ns ();
+wall0 = clock_wall ();
+virtual = 1;
+}
+
+
+int clock_is_virtual (void)
+{
+return virtual;
+}
+
+
+/********************************************************
+* clock_ns: Returns a monotonic time stamp.             *
+* Input:    Nothing.                                    *
+* Return:   time in ns, from an arbitrary start         *
+********************************************************/
+unsigned long long clock_ns (void)
+{
+return nanotime () + skipped;
+}
+
+
+/********************************************************
+* clock_wall: Returns the time of day.                  *
+* Input:    Nothing.                                    *
+* Return:   time in s since the Epoch                   *
+********************************************************/
+double clock_wall (void)
+{
+struct timeval t;
+
+if (virtual)
+    return wall0 + (clock_ns () - ns0) / 1e9;
+gettimeofday (&t, NULL);
+return (double)t.tv_sec + (double)t.tv_usec / 1000000.0;
+}
+
+
+/********************************************************
+* clock_sleep_until: Waits for a point in time.         *
+* Input:    - time in ns, as from clock_ns()            *
+* Return:   Nothing.                                    *
+********************************************************/
+void clock_sleep_until (unsigned long long ns)
+{
+struct timespec ts;
+unsigned long long now = clock_ns ();
+
+if (ns <= now)
+    return;
+if (virtual)
+    {
+    skipped += ns - now;
+    return;
+    }
+ts.tv_sec = ns / 1000000000ULL;
+ts.tv_nsec = ns % 1000000000ULL;
+while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+
+/********************************************************
+* clock_sleep: Waits for some time.                     *
+* Input:    - time in ns                                *
+* Return:   Nothing.                                    *
+********************************************************/
+void clock_sleep (unsigned long long ns)
+{
+clock_sleep_until (clock_ns () + ns);
+}
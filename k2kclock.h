@@ -0,0 +1,27 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K C L O C K . H
+
+ The clock of the acquisition: real, or running faster for soak tests.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KCLOCK_H
+#define K2KCLOCK_H
+
+void    clock_virtual (void);
+int     clock_is_virtual (void);
+unsigned long long clock_ns (void);
+double  clock_wall (void);
+void    clock_sleep_until (unsigned long long ns);
+void    clock_sleep (unsigned long long ns);
+
+#endif
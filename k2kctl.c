@@ -0,0 +1,443 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K C T L . C
+
+ Control socket for k2000 running as a daemon.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ A thread listening on a UNIX socket for commands, one per line, each
+ answered with one line starting with "ok" or "error":
+
+    status          state, samples, errors, last reading
+    start           resume acquisition
+    stop            pause acquisition (the data file stays open)
+    mark text       write "# Mark: <min> min, text" to the data file
+    set dt N        change the interval (as -t), the mode (as -m), the
+    set mode N      display (on, off), one or more at a time, e.g.
+    set display X   "set dt 5 mode 2"; done at the next sample
+    quit            end the run, as 'q' does
+    help            list the commands
+
+ 'status' is answered from a copy of the statistics, like the HTTP
+ endpoint does. The others are queued for the acquisition loop, which
+ takes them between two samples, so a client never holds up a reading.
+ While the loop waits for the next sampling time, ctl_sleep_until()
+ wakes it up for a command (or SIGTERM), so 'stop' and 'quit' do not
+ have to wait for a long sampling interval to pass.
+
+ One client at a time, served one after the other, as in k2khttp.c.
+
+*/
+
+#define _GNU_SOURCE     /* pipe2(), ppoll() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "k2kctl.h"
+#include "k2kclock.h"
+
+#define LINELEN 256         /* longest command */
+#define QLEN    16          /* commands not yet taken by the loop */
+#define IDLE_MS 60000       /* a client saying nothing is dropped */
+
+static int      sock = -1;
+static char     path[108];  /* of the socket, to remove at the end */
+static pthread_t thread;
+static atomic_int stop, paused, term;
+static char     config[LINELEN] = "";   /* what the loop runs with */
+static int      wake[2] = {-1, -1};     /* self-pipe: a command is queued */
+static const struct k2kstats *live;
+static struct k2kstats snap;            /* only used by the server thread */
+
+static struct
+{
+    int     cmd;
+    char    text[LINELEN];
+} q[QLEN];
+static int      qhead = 0, qtail = 0;   /* qhead == qtail: empty */
+static pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
+
+static void     *serve (void *arg);
+static void     client (int fd);
+static void     command (int fd, char *line);
+static int      queue (int cmd, const char *text);
+static void     queued (char *reply, int len, int ok);
+static int      set (char *arg, char *out, int len);
+static void     poke (void);
+static void     on_signal (int sig);
+
+
+/********************************************************
+* ctl_start: Starts the control thread; SIGTERM and     *
+*            SIGINT are made to end the run as well.    *
+* Input:    - path of the UNIX socket                   *
+*           - statistics, for 'status'                  *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int ctl_start (const char *where, const struct k2kstats *st)
+{
+struct sockaddr_un un;
+struct sigaction sa;
+
+live = st;
+if (strlen (where) >= sizeof(un.sun_path))
+    {
+    fprintf(stderr, "Control: socket path '%s' is too long.\n", where);
+    return 0;
+    }
+memset (&un, 0, sizeof(un));
+un.sun_family = AF_UNIX;
+strcpy (un.sun_path, where);
+unlink (where);                     /* left over from an earlier run */
+if (pipe2 (wake, O_CLOEXEC | O_NONBLOCK) < 0 ||
+    (sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+    bind (sock, (struct sockaddr *)&un, sizeof(un)) < 0 || listen (sock, 4) < 0)
+    goto fail;
+strcpy (path, where);
+
+atomic_store (&stop, 0);
+if (pthread_create (&thread, NULL, serve, NULL))
+    goto fail;
+
+memset (&sa, 0, sizeof(sa));
+sa.sa_handler = on_signal;          /* no SA_RESTART: wake up ppoll() */
+sigemptyset (&sa.sa_mask);
+sigaction (SIGTERM, &sa, NULL);
+sigaction (SIGINT, &sa, NULL);
+signal (SIGPIPE, SIG_IGN);          /* client gone before the answer */
+return 1;
+
+fail:
+fprintf(stderr, "Control: cannot listen on '%s': %s\n", where, strerror (errno));
+if (sock >= 0)
+    close (sock);
+sock = -1;
+return 0;
+}
+
+
+/********************************************************
+* ctl_stop: Stops the control thread.                   *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void ctl_stop (void)
+{
+if (sock < 0)
+    return;
+atomic_store (&stop, 1);
+pthread_join (thread, NULL);
+close (sock);
+sock = -1;
+unlink (path);
+}
+
+
+/********************************************************
+* ctl_next: Takes the next command for the acquisition  *
+*           loop.                                       *
+* Input:    - where to store the text of CTL_MARK       *
+*           - ... and its size                          *
+* Return:   CTL_NONE if there is none, else CTL_...     *
+********************************************************/
+int ctl_next (char *text, int len)
+{
+char    c;
+int     cmd = CTL_NONE;
+
+if (atomic_exchange (&term, 0))     /* once */
+    return CTL_QUIT;
+if (sock < 0)
+    return CTL_NONE;
+while (read (wake[0], &c, 1) == 1)  /* nothing to wake up for any more */
+    ;
+pthread_mutex_lock (&qlock);
+if (qhead != qtail)
+    {
+    cmd = q[qtail].cmd;
+    snprintf (text, len, "%s", q[qtail].text);
+    qtail = (qtail + 1) % QLEN;
+    }
+pthread_mutex_unlock (&qlock);
+return cmd;
+}
+
+
+/* the loop says whether it is paused, for 'status' */
+void ctl_paused (int p)
+{
+atomic_store (&paused, p);
+}
+
+
+/* ... and what it runs with */
+void ctl_config (const char *text)
+{
+pthread_mutex_lock (&qlock);
+snprintf (config, sizeof(config), "%s", text);
+pthread_mutex_unlock (&qlock);
+}
+
+
+/********************************************************
+* ctl_sleep_until: Waits like clock_sleep_until(), but  *
+*                  comes back early for a command.      *
+* Input:    - time to wake up, see clock_ns()           *
+* Return:   1 if the time has come, 0 if woken up early *
+********************************************************/
+int ctl_sleep_until (unsigned long long ns)
+{
+struct pollfd pfd;
+struct timespec ts;
+unsigned long long now;
+
+if (sock < 0 || clock_is_virtual ())
+    {
+    clock_sleep_until (ns);
+    return 1;
+    }
+pfd.fd = wake[0];
+pfd.events = POLLIN;
+while ((now = clock_ns ()) < ns)
+    {
+    if (atomic_load (&term))
+        return 0;
+    ts.tv_sec = (ns - now) / 1000000000ULL;
+    ts.tv_nsec = (ns - now) % 1000000000ULL;
+    if (ppoll (&pfd, 1, &ts, NULL) > 0)
+        return 0;
+    }
+return 1;
+}
+
+
+/* SIGTERM, SIGINT: end the run in an orderly way */
+static void on_signal (int sig)
+{
+(void)sig;
+atomic_store (&term, 1);
+poke ();
+}
+
+
+/* wakes up ctl_sleep_until(); safe in a signal handler */
+static void poke (void)
+{
+char    c = 0;
+
+if (write (wake[1], &c, 1) < 0)
+    return;                         /* pipe full: wakes up anyway */
+}
+
+
+/* hands a command to the loop; 0 if too many are waiting */
+static int queue (int cmd, const char *text)
+{
+int     ok = 0;
+
+pthread_mutex_lock (&qlock);
+if ((qhead + 1) % QLEN != qtail)
+    {
+    q[qhead].cmd = cmd;
+    snprintf (q[qhead].text, sizeof(q[0].text), "%s", text);
+    qhead = (qhead + 1) % QLEN;
+    ok = 1;
+    }
+pthread_mutex_unlock (&qlock);
+if (ok)
+    poke ();
+return ok;
+}
+
+
+/* the answer to a command handed to the loop */
+static void queued (char *reply, int len, int ok)
+{
+snprintf (reply, len, ok ? "ok\n" : "error busy, try again\n");
+}
+
+
+/* server thread: accept, talk, close */
+static void *serve (void *arg)
+{
+struct pollfd pfd;
+int     fd;
+
+(void)arg;
+pfd.fd = sock;
+pfd.events = POLLIN;
+while (!atomic_load (&stop))
+    {
+    if (poll (&pfd, 1, 200) <= 0)   /* look at 'stop' now and then */
+        continue;
+    if ((fd = accept (sock, NULL, NULL)) < 0)
+        continue;
+    client (fd);
+    close (fd);
+    }
+return NULL;
+}
+
+
+/********************************************************
+* client: Reads commands until the client hangs up, is  *
+*         silent for too long, or we stop.              *
+* Input:    - connected socket                          *
+* Return:   Nothing.                                    *
+********************************************************/
+static void client (int fd)
+{
+char    buf[LINELEN+1], *nl;
+struct pollfd pfd;
+size_t  got = 0;
+ssize_t n;
+int     idle = 0;
+
+pfd.fd = fd;
+pfd.events = POLLIN;
+while (!atomic_load (&stop) && idle < IDLE_MS)
+    {
+    if (poll (&pfd, 1, 200) <= 0)
+        {
+        idle += 200;
+        continue;
+        }
+    if ((n = read (fd, buf + got, LINELEN - got)) <= 0)
+        break;
+    idle = 0;
+    got += n;
+    buf[got] = 0;
+    while (NULL != (nl = strchr (buf, '\n')))
+        {
+        *nl = 0;
+        command (fd, buf);
+        got -= nl + 1 - buf;
+        memmove (buf, nl + 1, got + 1);
+        }
+    if (got == LINELEN)             /* no end of line in sight */
+        {
+        command (fd, "");
+        got = 0;
+        }
+    }
+}
+
+
+/********************************************************
+* command: Carries out one command and answers it.      *
+* Input:    - connected socket                          *
+*           - the line sent                             *
+* Return:   Nothing.                                    *
+********************************************************/
+static void command (int fd, char *line)
+{
+char    reply[2*LINELEN+128], *arg, conf[LINELEN];
+int     n;
+
+line[strcspn (line, "\r")] = 0;
+arg = line + strcspn (line, " \t");
+if (*arg)
+    *arg++ = 0;
+arg += strspn (arg, " \t");
+
+if (!strcmp (line, "status"))
+    {
+    stats_snapshot (&snap, live);
+    pthread_mutex_lock (&qlock);
+    snprintf (conf, sizeof(conf), "%s", config);
+    pthread_mutex_unlock (&qlock);
+    snprintf (reply, sizeof(reply), "ok %s samples=%llu errors=%llu recoveries=%llu last=%s %s\n",
+              atomic_load (&paused) ? "stopped" : "running", snap.samples, snap.errors,
+              snap.recoveries, snap.last[0] ? snap.last : "-", conf);
+    }
+else if (!strcmp (line, "start"))
+    queued (reply, sizeof(reply), queue (CTL_START, ""));
+else if (!strcmp (line, "stop"))
+    queued (reply, sizeof(reply), queue (CTL_STOP, ""));
+else if (!strcmp (line, "quit"))
+    queued (reply, sizeof(reply), queue (CTL_QUIT, ""));
+else if (!strcmp (line, "mark") && *arg)
+    queued (reply, sizeof(reply), queue (CTL_MARK, arg));
+else if (!strcmp (line, "mark"))
+    snprintf (reply, sizeof(reply), "error mark needs a text\n");
+else if (!strcmp (line, "set") && set (arg, conf, sizeof(conf)))
+    queued (reply, sizeof(reply), queue (CTL_SET, conf));
+else if (!strcmp (line, "set"))
+    snprintf (reply, sizeof(reply), "error set dt 0...600, mode 0...5, display on|off\n");
+else if (!strcmp (line, "help"))
+    snprintf (reply, sizeof(reply), "ok commands: status start stop mark set quit help\n");
+else
+    snprintf (reply, sizeof(reply), "error unknown command, try 'help'\n");
+
+n = strlen (reply);
+if (write (fd, reply, n) != n)
+    return;                         /* client gone, never mind */
+}
+
+
+/********************************************************
+* set: Checks the arguments of 'set', and puts them the *
+*      way the loop takes them.                         *
+* Input:    - arguments, e.g. "dt 5 display off"        *
+*           - where to store "dt 5 mode -1 display 0"   *
+*             (-1: unchanged), and its size             *
+* Return:   1 if OK, 0 if not                           *
+********************************************************/
+static int set (char *arg, char *out, int len)
+{
+char    *name, *value, *end;
+long    v;
+int     dt = -1, mode = -1, display = -1;
+
+for (name = strtok (arg, " \t"); name; name = strtok (NULL, " \t"))
+    {
+    if (NULL == (value = strtok (NULL, " \t")))
+        return 0;
+    if (!strcmp (name, "display"))
+        {
+        if (!strcmp (value, "on") || !strcmp (value, "1"))
+            display = 1;
+        else if (!strcmp (value, "off") || !strcmp (value, "0"))
+            display = 0;
+        else
+            return 0;
+        continue;
+        }
+    v = strtol (value, &end, 10);
+    if (*end)
+        return 0;
+    if (!strcmp (name, "dt") && v >= 0 && v <= 600)
+        dt = v;
+    else if (!strcmp (name, "mode") && v >= 0 && v <= 5)
+        mode = v;
+    else
+        return 0;
+    }
+if (dt < 0 && mode < 0 && display < 0)
+    return 0;
+snprintf (out, len, "dt %d mode %d display %d", dt, mode, display);
+return 1;
+}
@@ -0,0 +1,38 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K C T L . H
+
+ Control socket for k2000 running as a daemon.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KCTL_H
+#define K2KCTL_H
+
+#include "k2kmetrics.h"
+
+/* --- what the acquisition loop is asked to do --- */
+
+#define CTL_NONE    0
+#define CTL_START   1       /* resume acquisition */
+#define CTL_STOP    2       /* pause it, keep the file open */
+#define CTL_MARK    3       /* write a marker line, text given */
+#define CTL_QUIT    4       /* end the run (also SIGTERM, SIGINT) */
+#define CTL_SET     5       /* change the setup, text "dt N mode N display N" */
+
+int     ctl_start (const char *path, const struct k2kstats *st);
+void    ctl_stop (void);
+int     ctl_next (char *text, int len);
+void    ctl_paused (int paused);
+void    ctl_config (const char *text);
+int     ctl_sleep_until (unsigned long long ns);
+
+#endif
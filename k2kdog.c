@@ -0,0 +1,175 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K D O G . C
+
+ Watchdog for hanging GPIB transactions.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Every GPIB transaction should end within its I/O timeout. k2kbus.c
+ notes when the one in progress started (bus_since); a thread of its
+ own checks this a few times per 'grace' period. If a transaction is
+ still running 'grace' after its timeout, the driver hangs, and the
+ acquisition thread cannot do anything about it. So the watchdog sends
+ Interface Clear to the board, which makes the hanging call return with
+ an error; the recovery in k2000.c then takes over (device clear, setup
+ again). If the call does not return, IFC is repeated every 'grace', at
+ most IFC_MAX times.
+
+ The time from the start of the stall until the call returned is the
+ time to recovery. Stalls and the total time are counted here, since
+ only the acquisition thread writes the statistics of k2kmetrics.c.
+
+*/
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "k2kbus.h"
+#include "k2khist.h"
+#include "k2kdog.h"
+
+#define IFC_MAX     3       /* per stall */
+
+static pthread_t    dog;
+static atomic_int   stop;
+static int          running = 0, brd;
+static unsigned long long grace;
+static atomic_ullong stalls, recovery, worst;
+
+static void *watch (void *arg);
+
+
+/********************************************************
+* dog_start: Starts the watchdog thread.                *
+* Input:    - board index for Interface Clear           *
+*           - grace period beyond the I/O timeout (ns)  *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int dog_start (int board, unsigned long long ns)
+{
+brd = board;
+grace = ns;
+atomic_store (&stop, 0);
+bus_watched = 1;
+if (pthread_create (&dog, NULL, watch, NULL))
+    {
+    bus_watched = 0;
+    fprintf(stderr, "Could not start the bus watchdog.\n");
+    return 0;
+    }
+running = 1;
+return 1;
+}
+
+
+/********************************************************
+* dog_stop: Stops the watchdog thread.                  *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void dog_stop (void)
+{
+if (!running)
+    return;
+atomic_store (&stop, 1);
+pthread_join (dog, NULL);
+bus_watched = running = 0;
+}
+
+
+unsigned long long dog_stalls (void)
+{
+return atomic_load_explicit (&stalls, memory_order_relaxed);
+}
+
+unsigned long long dog_recovery_ns (void)
+{
+return atomic_load_explicit (&recovery, memory_order_relaxed);
+}
+
+
+/********************************************************
+* dog_report: Prints stalls and time to recovery.       *
+* Input:    - file to print to                          *
+*           - line prefix (e.g. "# " for data file)     *
+* Return:   Nothing.                                    *
+********************************************************/
+void dog_report (FILE *fp, const char *prefix)
+{
+unsigned long long n = dog_stalls ();
+
+if (n)
+    fprintf(fp, "%sBus stalls: %llu, time to recovery mean %.3f, max %.3f ms\n", prefix, n,
+            dog_recovery_ns () / 1e6 / n, atomic_load (&worst) / 1e6);
+}
+
+
+/* the watchdog thread */
+static void *watch (void *arg)
+{
+struct timespec ts;
+unsigned long long since, now, stalled = 0, next = 0, ns;
+int     ifc = 0;
+
+(void)arg;
+ns = grace / 4;                         /* check a few times per grace period */
+if (ns < 10000000ULL)
+    ns = 10000000ULL;
+if (ns > 250000000ULL)
+    ns = 250000000ULL;
+ts.tv_sec = ns / 1000000000ULL;
+ts.tv_nsec = ns % 1000000000ULL;
+
+while (!atomic_load (&stop))
+    {
+    nanosleep (&ts, NULL);
+    since = atomic_load_explicit (&bus_since, memory_order_acquire);
+    now = nanotime ();
+
+    if (stalled && since != stalled)    /* the hanging call has returned */
+        {
+        ns = atomic_load (&bus_ended) - stalled;
+        atomic_fetch_add (&recovery, ns);
+        if (ns > atomic_load (&worst))
+            atomic_store (&worst, ns);
+        fprintf(stderr, "\nWatchdog: bus free again after %.3f ms.\n", ns / 1e6);
+        stalled = 0;
+        }
+    if (!since || now - since < bus_timeout_ns () + grace)
+        continue;
+
+    if (stalled != since)               /* a new stall */
+        {
+        stalled = since;
+        ifc = 0;
+        next = now;
+        atomic_fetch_add (&stalls, 1);
+        fprintf(stderr, "\nWatchdog: bus transaction hangs for %.3f ms, sending IFC.\n",
+                (now - since) / 1e6);
+        }
+    if (ifc < IFC_MAX && now >= next)
+        {
+        bus_ifc (brd);
+        ifc++;
+        next = now + grace;
+        if (ifc == IFC_MAX)
+            fprintf(stderr, "\nWatchdog: bus still hangs after %d IFC, giving up.\n", IFC_MAX);
+        }
+    }
+return NULL;
+}
@@ -0,0 +1,28 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K D O G . H
+
+ Watchdog for hanging GPIB transactions.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KDOG_H
+#define K2KDOG_H
+
+#include <stdio.h>
+
+int     dog_start (int board, unsigned long long grace);
+void    dog_stop (void);
+unsigned long long dog_stalls (void);
+unsigned long long dog_recovery_ns (void);
+void    dog_report (FILE *fp, const char *prefix);
+
+#endif
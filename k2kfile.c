@@ -0,0 +1,243 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K F I L E . C
+
+ Reading of k2000 data files: header and data lines.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ A k2000 data file looks like this:
+
+    # k2000 V20170725
+    # Instrument: KEITHLEY INSTRUMENTS INC.,MODEL 2000,...
+    # comment text
+    # Acquisition start: Tue Jul 25 10:12:00 2017
+    # min   readout
+    0.0167  +1.23456789E-03VDC
+    0.0333  OVERFLOW
+    ...
+    # Acquisition stop: Tue Jul 25 11:12:00 2017
+
+ i.e. '#' header lines, then one line per sample with the time in
+ minutes since acquisition start, a TAB, and the reading as sent by the
+ instrument (value with unit suffix, or "OVERFLOW"). These routines are
+ shared by the k2k* tools; they read one line at a time and so work on
+ files of any size.
+
+*/
+
+#define _GNU_SOURCE     /* strptime() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "k2kfile.h"
+
+static int  readline (FILE *fp, char *buf, int len);
+static void chomp (char *buf);
+
+
+/********************************************************
+* k2k_open: Opens a data file and reads its header.     *
+* Input:    - pointer to file structure                 *
+*           - file name                                 *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int k2k_open (struct k2kfile *f, const char *name)
+{
+char    line[K2K_MAXLEN+1];
+
+memset (f, 0, sizeof(*f));
+strncpy (f->name, name, K2K_MAXLEN);
+if (NULL == (f->fp = fopen(name, "rt")))
+    return 0;
+setvbuf (f->fp, NULL, _IOFBF, 1 << 16);     /* fewer read() calls on big files */
+
+while (readline (f->fp, line, sizeof(line)))
+    {
+    f->lineno++;
+    if (k2k_header (f, line))
+        continue;
+    if (!line[0])               /* empty line */
+        continue;
+    strcpy (f->pending, line);  /* first data line, keep for k2k_next() */
+    f->has_pending = 1;
+    break;
+    }
+return 1;
+}
+
+
+/********************************************************
+* k2k_next: Reads the next data line.                   *
+* Input:    - pointer to file structure                 *
+*           - pointer to record to fill in              *
+* Return:   1 if a record was read, 0 at end of file    *
+* Note:     Comment and malformed lines are skipped.    *
+********************************************************/
+int k2k_next (struct k2kfile *f, struct k2krec *r)
+{
+char    line[K2K_MAXLEN+1];
+
+if (f->has_pending)
+    {
+    f->has_pending = 0;
+    if (k2k_parse (f->pending, r))
+        return 1;
+    }
+
+while (readline (f->fp, line, sizeof(line)))
+    {
+    f->lineno++;
+    if (line[0] == '#' || !line[0])
+        continue;
+    if (k2k_parse (line, r))
+        return 1;
+    }
+return 0;
+}
+
+
+/********************************************************
+* k2k_close: Closes a data file.                        *
+* Input:    - pointer to file structure                 *
+* Return:   Nothing.                                    *
+********************************************************/
+void k2k_close (struct k2kfile *f)
+{
+if (f->fp)
+    fclose (f->fp);
+f->fp = NULL;
+}
+
+
+/********************************************************
+* k2k_header: Decodes a '#' header line.                *
+* Input:    - pointer to file structure                 *
+*           - line, without trailing newline            *
+* Return:   1 if this was a header line, 0 if not       *
+********************************************************/
+int k2k_header (struct k2kfile *f, const char *line)
+{
+const char *p;
+struct tm tm;
+
+if (line[0] != '#')
+    return 0;
+p = line + 1;
+while (*p == ' ')
+    p++;
+
+if (!strncmp (p, "k2000 ", 6))
+    strncpy (f->version, p, K2K_MAXLEN);
+else if (!strncmp (p, "Instrument: ", 12))
+    strncpy (f->instrument, p + 12, K2K_MAXLEN);
+else if (!strncmp (p, "Acquisition start: ", 19))
+    {
+    memset (&tm, 0, sizeof(tm));
+    if (strptime (p + 19, "%a %b %d %H:%M:%S %Y", &tm))
+        {
+        tm.tm_isdst = -1;       /* ctime() wrote local time */
+        f->start = mktime (&tm);
+        }
+    }
+else if (!strncmp (p, "Acquisition stop: ", 18))
+    ;
+else if (!strncmp (p, "min\t", 4))
+    ;
+else if (!f->comment[0] && !f->start)  /* free text before the start line */
+    strncpy (f->comment, p, K2K_MAXLEN);
+return 1;
+}
+
+
+/********************************************************
+* k2k_parse: Decodes one data line.                     *
+* Input:    - line "minutes<TAB>reading"                *
+*           - pointer to record to fill in              *
+* Return:   1 if OK, 0 if not a data line               *
+********************************************************/
+int k2k_parse (const char *line, struct k2krec *r)
+{
+char    *end;
+const char *unit;
+
+r->t = strtod (line, &end);
+if (end == line || (*end != '\t' && *end != ' '))
+    return 0;
+while (*end == '\t' || *end == ' ')
+    end++;
+
+strncpy (r->text, end, K2K_MAXLEN);
+r->text[K2K_MAXLEN] = 0;
+chomp (r->text);
+
+r->value = k2k_reading (r->text, &unit);
+strncpy (r->unit, unit, K2K_MAXUNIT);
+r->unit[K2K_MAXUNIT] = 0;
+return 1;
+}
+
+
+/********************************************************
+* k2k_reading: Converts a reading to a number.          *
+* Input:    - reading as sent by the K2000, such as     *
+*             "+1.23456789E-03VDC" or "OVERFLOW"        *
+*           - where to store pointer to unit suffix     *
+*             (may be NULL)                             *
+* Return:   value, NAN if overflow or not a number      *
+********************************************************/
+double k2k_reading (const char *s, const char **unit)
+{
+char    *end;
+double  val;
+
+if (unit)
+    *unit = "";
+if (!strncmp (s, "OVERFLOW", 8))
+    return NAN;
+
+val = strtod (s, &end);
+if (end == s)
+    return NAN;
+if (unit)
+    *unit = end;
+if (fabs(val) >= 9.9e37)    /* the K2000's overflow value */
+    return NAN;
+return val;
+}
+
+
+/* reads one line, removes CR/LF, drops the rest of overlong lines */
+static int readline (FILE *fp, char *buf, int len)
+{
+int c;
+
+if (NULL == fgets (buf, len, fp))
+    return 0;
+if (!strchr (buf, '\n'))
+    while ((c = fgetc (fp)) != EOF && c != '\n')
+        ;
+chomp (buf);
+return 1;
+}
+
+static void chomp (char *buf)
+{
+buf[strcspn (buf, "\r\n")] = 0;
+}
@@ -0,0 +1,95 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K F I L E . H
+
+ Reading of k2000 data files: header and data lines.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KFILE_H
+#define K2KFILE_H
+
+#include <stdio.h>
+#include <time.h>
+
+#define K2K_MAXLEN  255     /* longest line we care about */
+#define K2K_MAXUNIT 15      /* unit suffix such as "VDC" */
+
+/* --- one open data file --- */
+
+struct k2kfile
+{
+    FILE    *fp;
+    char    name[K2K_MAXLEN+1];
+    char    version[K2K_MAXLEN+1];      /* "k2000 Vyyyymmdd" */
+    char    instrument[K2K_MAXLEN+1];   /* *idn? string */
+    char    comment[K2K_MAXLEN+1];
+    time_t  start;                      /* acquisition start, 0 if unknown */
+    unsigned long lineno;
+    char    pending[K2K_MAXLEN+1];      /* first data line, read with the header */
+    int     has_pending;
+};
+
+/* --- one data line --- */
+
+struct k2krec
+{
+    double  t;                          /* minutes since acquisition start */
+    double  value;                      /* reading, NAN if OVERFLOW */
+    char    unit[K2K_MAXUNIT+1];        /* unit suffix, may be empty */
+    char    text[K2K_MAXLEN+1];         /* reading literally as in file */
+};
+
+/* --- a whole data file, memory-mapped (k2kmap.c) --- */
+
+struct k2kmap
+{
+    struct k2kfile  info;               /* header; info.fp is not used */
+    const char  *base;                  /* start of mapping */
+    const char  *data;                  /* first data line */
+    const char  *end;                   /* end of mapping */
+    size_t      size;
+    char        unit[K2K_MAXUNIT+1];    /* unit of the first reading */
+};
+
+/* --- a data file that is still being written (k2kwatch.c) --- */
+
+#define K2K_BUFSIZE 65536
+
+struct k2kfollow
+{
+    struct k2kfile  info;               /* header; info.fp is not used */
+    int     fd;                         /* data file */
+    int     ino;                        /* inotify instance */
+    long long offset;                   /* of the next line not yet returned */
+    unsigned long index;                /* number of the next sample */
+    int     ended;                      /* "Acquisition stop" seen */
+    char    buf[K2K_BUFSIZE];           /* bytes read beyond 'offset' */
+    size_t  have, used;
+};
+
+int     k2k_open (struct k2kfile *f, const char *name);
+int     k2k_next (struct k2kfile *f, struct k2krec *r);
+void    k2k_close (struct k2kfile *f);
+int     k2k_header (struct k2kfile *f, const char *line);
+int     k2k_parse (const char *line, struct k2krec *r);
+double  k2k_reading (const char *s, const char **unit);
+
+int     k2k_map (struct k2kmap *m, const char *name);
+void    k2k_unmap (struct k2kmap *m);
+size_t  k2k_columns (struct k2kmap *m, size_t *pos, double *t, double *v, size_t max);
+const char *k2k_number (const char *p, const char *end, double *val);
+
+int     k2k_follow (struct k2kfollow *f, const char *name, long long offset, long index);
+int     k2k_follow_next (struct k2kfollow *f, struct k2krec *r, int timeout);
+void    k2k_unfollow (struct k2kfollow *f);
+
+#endif
@@ -0,0 +1,135 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K F O L L O W . C
+
+ Follows a k2000 data file while the acquisition is running.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Like 'tail -f', but only ever writes complete samples, wakes up only
+ when the file was written to (inotify), stops by itself at the end of
+ the acquisition, and can resume where a previous run left off.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2kfollow.c k2kwatch.c k2kfile.c -lm -o k2kfollow
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>     /* getopt() */
+#include "k2kfile.h"
+
+#define ERR_FILE  4         /* error code */
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal (int sig)
+{
+(void)sig;
+stop = 1;
+}
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kfollow [-h] [-o offset] [-i index] [-n] [-v] [-t sec] datafile"
+"\n        -h         this help screen"
+"\n        -o offset  start at this byte offset (as printed at exit)"
+"\n        -i index   with -o: sample index at that offset; else: skip this many samples"
+"\n        -n         prefix each line with sample index and offset to resume after it"
+"\n        -v         write numeric values only (default: readings as in the file)"
+"\n        -t sec     give up after sec seconds without new data (default: never)\n\n";
+
+struct k2kfollow f;
+struct k2krec r;
+struct sigaction sa;
+long long offset = 0;
+long    index = 0;
+int     key, ret, do_number = 0, do_numeric = 0, timeout = -1;
+
+while ((key = getopt(argc, argv, "ho:i:nvt:")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 'o':
+            offset = atoll (optarg);
+            continue;
+        case 'i':
+            index = atol (optarg);
+            continue;
+        case 'n':
+            do_number = 1;
+            continue;
+        case 'v':
+            do_numeric = 1;
+            continue;
+        case 't':
+            timeout = (int)(atof (optarg) * 1000.0);
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+if (argv[optind] == NULL)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify a data file.\n");
+    return 1;
+    }
+
+memset (&sa, 0, sizeof(sa));        /* no SA_RESTART: poll() returns */
+sa.sa_handler = on_signal;
+sigaction (SIGINT, &sa, NULL);
+sigaction (SIGTERM, &sa, NULL);
+
+if (!k2k_follow (&f, argv[optind], offset, index))
+    {
+    fprintf(stderr, "Could not follow '%s'.\n", argv[optind]);
+    return ERR_FILE;
+    }
+setvbuf (stdout, NULL, _IOLBF, 0);
+
+while (!stop)
+    {
+    ret = k2k_follow_next (&f, &r, timeout);
+    if (ret <= 0)
+        break;
+    if (do_number)
+        printf("%lu\t%lld\t", f.index - 1, f.offset);
+    if (!do_numeric)
+        printf("%.4f\t%s\n", r.t, r.text);
+    else if (isnan(r.value))
+        printf("%.4f\tNaN\n", r.t);
+    else
+        printf("%.4f\t%.9g\n", r.t, r.value);
+    }
+
+/* tell the caller where to continue */
+fprintf(stderr, "k2kfollow: -o %lld -i %lu%s\n", f.offset, f.index,
+        f.ended ? " (acquisition ended)" : "");
+k2k_unfollow (&f);
+return 0;
+}
@@ -0,0 +1,153 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K H I S T . C
+
+ Fixed-size latency histograms.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Log-linear buckets in the spirit of HdrHistogram: values below 32 ns
+ have a bin each, above that every power of two is split into 32 bins.
+ Adding a value is a few integer operations, there is no allocation,
+ and quantiles are within 3% of the true value over the whole range
+ from nanoseconds to days.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "k2khist.h"
+
+#define SUBCOUNT    (1 << HIST_SUB)
+
+
+/* bin of a value */
+static int bin_of (unsigned long long v)
+{
+int e;
+
+if (v < SUBCOUNT)
+    return (int)v;
+if (v >= (1ULL << HIST_BITS))
+    v = (1ULL << HIST_BITS) - 1;
+e = 63 - __builtin_clzll (v);               /* highest bit set */
+return ((e - HIST_SUB + 1) << HIST_SUB) + (int)((v >> (e - HIST_SUB)) & (SUBCOUNT - 1));
+}
+
+/* middle of the value range of a bin */
+static unsigned long long value_of (int b)
+{
+int g = b >> HIST_SUB, m = b & (SUBCOUNT - 1);
+unsigned long long lo, width;
+
+if (g == 0)
+    return (unsigned long long)m;
+width = 1ULL << (g - 1);
+lo = (unsigned long long)(SUBCOUNT + m) << (g - 1);
+return lo + width / 2;
+}
+
+
+/********************************************************
+* hist_clear: Empties a histogram.                      *
+* Input:    - pointer to histogram                      *
+* Return:   Nothing.                                    *
+********************************************************/
+void hist_clear (struct hist *h)
+{
+memset (h, 0, sizeof(*h));
+}
+
+
+/********************************************************
+* hist_add: Adds a value to a histogram.                *
+* Input:    - pointer to histogram                      *
+*           - value in ns                               *
+* Return:   Nothing.                                    *
+********************************************************/
+void hist_add (struct hist *h, unsigned long long ns)
+{
+if (!h->count++ || ns < h->min)
+    h->min = ns;
+if (ns > h->max)
+    h->max = ns;
+h->sum += ns;
+h->bin[bin_of (ns)]++;
+}
+
+
+/********************************************************
+* hist_quantile: Returns a quantile of a histogram.     *
+* Input:    - pointer to histogram                      *
+*           - quantile, 0...1 (e.g. 0.99)               *
+* Return:   value in ns, 0 if histogram is empty        *
+********************************************************/
+unsigned long long hist_quantile (const struct hist *h, double q)
+{
+unsigned long long rank, seen = 0, v;
+int b;
+
+if (!h->count)
+    return 0;
+if (q >= 1.0)
+    return h->max;
+rank = (unsigned long long)(q * (double)h->count) + 1;
+for (b = 0; b < HIST_BINS; b++)
+    {
+    seen += h->bin[b];
+    if (seen >= rank)
+        break;
+    }
+v = value_of (b);
+if (v < h->min)                 /* exact ends are known */
+    v = h->min;
+if (v > h->max)
+    v = h->max;
+return v;
+}
+
+
+/********************************************************
+* hist_print: Prints quantiles in ms, on one line.      *
+* Input:    - file to print to                          *
+*           - line prefix (e.g. "# ")                   *
+*           - name of the histogram                     *
+*           - pointer to histogram                      *
+* Return:   Nothing.                                    *
+********************************************************/
+void hist_print (FILE *fp, const char *prefix, const char *name, const struct hist *h)
+{
+fprintf(fp, "%s%-18s p50 %9.3f  p90 %9.3f  p99 %9.3f  p99.9 %9.3f  max %9.3f ms (n=%llu)\n",
+        prefix, name,
+        hist_quantile (h, 0.5) / 1e6, hist_quantile (h, 0.9) / 1e6,
+        hist_quantile (h, 0.99) / 1e6, hist_quantile (h, 0.999) / 1e6,
+        h->max / 1e6, h->count);
+}
+
+
+/********************************************************
+* nanotime: Returns a monotonic time stamp.             *
+* Input:    Nothing.                                    *
+* Return:   time in ns, from an arbitrary start         *
+********************************************************/
+unsigned long long nanotime (void)
+{
+struct timespec ts;
+
+clock_gettime (CLOCK_MONOTONIC, &ts);
+return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,38 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K H I S T . H
+
+ Fixed-size latency histograms.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KHIST_H
+#define K2KHIST_H
+
+#include <stdio.h>
+
+#define HIST_SUB    5       /* 2^5 bins per power of two: < 3% error */
+#define HIST_BITS   48      /* values up to 2^48 ns, i.e. 3 days */
+#define HIST_BINS   ((HIST_BITS - HIST_SUB + 1) << HIST_SUB)
+
+struct hist
+{
+    unsigned long long count, sum, min, max;    /* ns */
+    unsigned long long bin[HIST_BINS];
+};
+
+void    hist_clear (struct hist *h);
+void    hist_add (struct hist *h, unsigned long long ns);
+unsigned long long hist_quantile (const struct hist *h, double q);
+void    hist_print (FILE *fp, const char *prefix, const char *name, const struct hist *h);
+unsigned long long nanotime (void);
+
+#endif
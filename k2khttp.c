@@ -0,0 +1,279 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K H T T P . C
+
+ Minimal HTTP endpoint for live metrics and latest readings.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ A small HTTP/1.1 server in a thread of its own, listening either on
+ localhost:port or on a UNIX socket. It knows two pages:
+
+    /metrics    counters and latency quantiles (OpenMetrics text)
+    /latest     the most recent readings (JSON)
+
+ Both are built from a copy of the statistics taken with
+ stats_snapshot(), so the acquisition loop never waits for a client.
+ One request per connection, served one after the other - this is meant
+ for a monitoring system and the odd curl, not for the whole lab.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "k2khttp.h"
+
+#define REQLEN  2048        /* longest request we read */
+
+static int      sock = -1;
+static char     path[108];  /* of UNIX socket, to remove at the end */
+static pthread_t thread;
+static atomic_int stop;
+static const struct k2kstats *live;
+static const char *lbl;
+static struct k2kstats snap;    /* only used by the server thread */
+
+static void     *serve (void *arg);
+static void     answer (int fd);
+static void     latest_json (FILE *fp, const struct k2kstats *st);
+
+
+/********************************************************
+* http_start: Starts the server thread.                 *
+* Input:    - "port" for localhost:port, or path of a   *
+*             UNIX socket (anything containing '/')     *
+*           - statistics to publish                     *
+*           - metrics label set                         *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int http_start (const char *where, const struct k2kstats *st, const char *labels)
+{
+struct sockaddr_in in;
+struct sockaddr_un un;
+int     one = 1;
+
+live = st;
+lbl = labels;
+if (strchr (where, '/'))
+    {
+    if (strlen (where) >= sizeof(un.sun_path))
+        return 0;
+    memset (&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strcpy (un.sun_path, where);
+    unlink (where);                 /* left over from an earlier run */
+    if ((sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+        bind (sock, (struct sockaddr *)&un, sizeof(un)) < 0)
+        goto fail;
+    strcpy (path, where);
+    }
+else
+    {
+    memset (&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons ((unsigned short)atoi (where));
+    in.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    if ((sock = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        goto fail;
+    setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind (sock, (struct sockaddr *)&in, sizeof(in)) < 0)
+        goto fail;
+    }
+if (listen (sock, 8) < 0)
+    goto fail;
+
+atomic_store (&stop, 0);
+if (pthread_create (&thread, NULL, serve, NULL))
+    goto fail;
+return 1;
+
+fail:
+fprintf(stderr, "HTTP: cannot listen on '%s': %s\n", where, strerror (errno));
+if (sock >= 0)
+    close (sock);
+sock = -1;
+return 0;
+}
+
+
+/********************************************************
+* http_stop: Stops the server thread.                   *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void http_stop (void)
+{
+if (sock < 0)
+    return;
+atomic_store (&stop, 1);
+pthread_join (thread, NULL);
+close (sock);
+sock = -1;
+if (path[0])
+    unlink (path);
+}
+
+
+/* server thread: accept, answer, close */
+static void *serve (void *arg)
+{
+struct pollfd pfd;
+struct timeval tv = {1, 0};
+int     fd;
+
+(void)arg;
+pfd.fd = sock;
+pfd.events = POLLIN;
+while (!atomic_load (&stop))
+    {
+    if (poll (&pfd, 1, 200) <= 0)   /* look at 'stop' now and then */
+        continue;
+    if ((fd = accept (sock, NULL, NULL)) < 0)
+        continue;
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    answer (fd);
+    close (fd);
+    }
+return NULL;
+}
+
+
+/********************************************************
+* answer: Reads one request and sends the answer.       *
+* Input:    - connected socket                          *
+* Return:   Nothing.                                    *
+********************************************************/
+static void answer (int fd)
+{
+char    req[REQLEN+1], url[256], head[256];
+char    *body = NULL;
+size_t  len = 0, got = 0, sent;
+const char *status = "200 OK", *type = "text/plain";
+struct timeval tv;
+ssize_t n;
+FILE    *fp;
+
+/* --- request line and headers --- */
+req[0] = 0;
+while (got < REQLEN && !strstr (req, "\r\n\r\n"))
+    {
+    if ((n = read (fd, req + got, REQLEN - got)) <= 0)
+        break;
+    got += n;
+    req[got] = 0;
+    }
+req[got] = 0;
+if (sscanf (req, "GET %255s HTTP/1.%*c", url) != 1)
+    {
+    status = "405 Method Not Allowed";
+    url[0] = 0;
+    }
+url[strcspn (url, "?")] = 0;        /* no query parameters */
+
+if (NULL == (fp = open_memstream (&body, &len)))
+    return;
+gettimeofday (&tv, NULL);
+if (!url[0])
+    fprintf(fp, "Only GET is supported.\n");
+else if (!strcmp (url, "/metrics"))
+    {
+    stats_snapshot (&snap, live);
+    metrics_write (fp, &snap, lbl, tv.tv_sec + tv.tv_usec / 1e6);
+    type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    }
+else if (!strcmp (url, "/latest"))
+    {
+    stats_snapshot (&snap, live);
+    latest_json (fp, &snap);
+    type = "application/json";
+    }
+else
+    {
+    status = "404 Not Found";
+    fprintf(fp, "Try /metrics or /latest.\n");
+    }
+fclose (fp);
+
+n = snprintf (head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+              "Content-Length: %lu\r\nConnection: close\r\n\r\n", status, type, (unsigned long)len);
+if (write (fd, head, n) == n)
+    for (sent = 0; sent < len; sent += n)
+        if ((n = write (fd, body + sent, len - sent)) <= 0)
+            break;
+free (body);
+}
+
+
+/* string as JSON, the readings are plain ASCII anyway */
+static void json_string (FILE *fp, const char *s)
+{
+fputc ('"', fp);
+for ( ; *s; s++)
+    if (*s == '"' || *s == '\\')
+        fprintf(fp, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+        fprintf(fp, "\\u%04x", *s);
+    else
+        fputc (*s, fp);
+fputc ('"', fp);
+}
+
+/********************************************************
+* latest_json: Writes the most recent readings, oldest  *
+*              first.                                   *
+* Input:    - file to write to                          *
+*           - statistics snapshot                       *
+* Return:   Nothing.                                    *
+********************************************************/
+static void latest_json (FILE *fp, const struct k2kstats *st)
+{
+unsigned long long i, first;
+char    *end;
+double  v;
+int     k;
+
+first = (st->samples > LATEST) ? st->samples - LATEST : 0;
+fprintf(fp, "{\"samples\": %llu, \"readings\": [", st->samples);
+for (i = first; i < st->samples; i++)
+    {
+    k = (int)(i % LATEST);
+    v = strtod (st->latest[k].text, &end);
+    fprintf(fp, "%s\n  {\"index\": %llu, \"time\": %.3f, \"reading\": ", (i > first) ? "," : "",
+            i, st->latest[k].time);
+    json_string (fp, st->latest[k].text);
+    if (end == st->latest[k].text || fabs (v) >= 9.9e37)
+        fprintf(fp, ", \"value\": null, \"unit\": \"\"}");
+    else
+        {
+        fprintf(fp, ", \"value\": %.10g, \"unit\": ", v);
+        json_string (fp, end);
+        fputc ('}', fp);
+        }
+    }
+fprintf(fp, "\n]}\n");
+}
@@ -0,0 +1,25 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K H T T P . H
+
+ Minimal HTTP endpoint for live metrics and latest readings.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KHTTP_H
+#define K2KHTTP_H
+
+#include "k2kmetrics.h"
+
+int     http_start (const char *where, const struct k2kstats *st, const char *labels);
+void    http_stop (void);
+
+#endif
@@ -0,0 +1,324 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K M A P . C
+
+ Fast reading of k2000 data files through mmap().
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ The file is mapped once, its header is decoded with k2k_header(), and
+ k2k_columns() then converts the data lines straight from the mapping
+ into two arrays (minutes, value) - no copying of lines, no stdio, no
+ strtod().
+
+ Numbers are converted by k2k_number(). The K2000 sends its readings as
+ "+1.23456789E-03VDC", i.e. exactly eight decimals, which are converted
+ in one go with a few 64-bit operations (SWAR: "SIMD within a register").
+ The mantissa is collected as an integer and scaled by an exact power of
+ ten, which gives the same, correctly rounded, result as strtod(). Odd
+ cases (too many digits, huge exponents) are handed over to strtod().
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "k2kfile.h"
+
+static const double pow10tab[] =        /* exact in double precision */
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define ISDIGIT(c)  ((unsigned char)((c) - '0') < 10)
+
+
+/********************************************************
+* k2k_map: Maps a data file and reads its header.       *
+* Input:    - pointer to map structure                  *
+*           - file name                                 *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int k2k_map (struct k2kmap *m, const char *name)
+{
+struct stat st;
+char    line[K2K_MAXLEN+1];
+const char *p, *nl;
+const char *unit;
+size_t  len;
+int     fd;
+
+memset (m, 0, sizeof(*m));
+strncpy (m->info.name, name, K2K_MAXLEN);
+
+if ((fd = open (name, O_RDONLY)) < 0)
+    return 0;
+if (fstat (fd, &st) < 0)
+    {
+    close (fd);
+    return 0;
+    }
+m->size = st.st_size;
+if (m->size > 0)
+    {
+    m->base = mmap (NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m->base == MAP_FAILED)
+        {
+        m->base = NULL;
+        close (fd);
+        return 0;
+        }
+    madvise ((void *)m->base, m->size, MADV_SEQUENTIAL);
+    }
+close (fd);                     /* mapping stays valid */
+m->end = m->base + m->size;
+
+/* --- header: leading '#' and empty lines --- */
+
+p = m->base;
+while (p < m->end)
+    {
+    nl = memchr (p, '\n', m->end - p);
+    len = (nl ? nl : m->end) - p;
+    if (len > K2K_MAXLEN)
+        len = K2K_MAXLEN;
+    memcpy (line, p, len);
+    line[len] = 0;
+    line[strcspn (line, "\r")] = 0;
+    m->info.lineno++;
+    if (!k2k_header (&m->info, line) && line[0])
+        break;
+    p = nl ? nl + 1 : m->end;
+    }
+m->data = p;
+
+/* --- remember the unit of the first reading --- */
+
+if (p < m->end)
+    {
+    nl = memchr (p, '\n', m->end - p);
+    len = (nl ? nl : m->end) - p;
+    if (len > K2K_MAXLEN)
+        len = K2K_MAXLEN;
+    memcpy (line, p, len);
+    line[len] = 0;
+    if ((p = strchr (line, '\t')) != NULL)
+        {
+        k2k_reading (p + 1, &unit);
+        strncpy (m->unit, unit, K2K_MAXUNIT);
+        m->unit[strcspn (m->unit, "\r")] = 0;
+        }
+    }
+return 1;
+}
+
+
+/********************************************************
+* k2k_unmap: Releases a mapped data file.               *
+* Input:    - pointer to map structure                  *
+* Return:   Nothing.                                    *
+********************************************************/
+void k2k_unmap (struct k2kmap *m)
+{
+if (m->base)
+    munmap ((void *)m->base, m->size);
+m->base = m->data = m->end = NULL;
+}
+
+
+/********************************************************
+* k2k_columns: Converts data lines to numeric columns.  *
+* Input:    - pointer to map structure                  *
+*           - byte offset into the data, updated; start *
+*             with 0 and call again until 0 is returned *
+*           - array for minutes (may be NULL)           *
+*           - array for values (may be NULL)            *
+*           - size of the arrays                        *
+* Return:   number of records stored                    *
+* Note:     OVERFLOW gives NAN. Comment, empty and      *
+*           malformed lines are skipped.                *
+********************************************************/
+size_t k2k_columns (struct k2kmap *m, size_t *pos, double *t, double *v, size_t max)
+{
+const char *p = m->data + *pos, *end = m->end, *q, *nl;
+double  tt, vv;
+size_t  n = 0;
+
+while (n < max && p < end)
+    {
+    if (*p == '#' || *p == '\n' || *p == '\r')
+        goto skip;
+
+    if (NULL == (q = k2k_number (p, end, &tt)))
+        goto skip;
+    if (q >= end || (*q != '\t' && *q != ' '))
+        goto skip;
+    while (q < end && (*q == '\t' || *q == ' '))
+        q++;
+
+    if (end - q >= 8 && !memcmp (q, "OVERFLOW", 8))
+        {
+        vv = NAN;
+        q += 8;
+        }
+    else if (NULL == (q = k2k_number (q, end, &vv)))
+        goto skip;
+    else if (fabs(vv) >= 9.9e37)
+        vv = NAN;
+
+    if (t)
+        t[n] = tt;
+    if (v)
+        v[n] = vv;
+    n++;
+    p = q;                      /* unit suffix and newline follow */
+
+skip:
+    nl = memchr (p, '\n', end - p);
+    p = nl ? nl + 1 : end;
+    }
+
+*pos = p - m->data;
+return n;
+}
+
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HAVE_SWAR
+/* are all eight bytes ASCII digits? */
+static int is_eight_digits (uint64_t w)
+{
+return (((w & 0xF0F0F0F0F0F0F0F0ULL) |
+        (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        == 0x3333333333333333ULL);
+}
+
+/* converts eight ASCII digits, first digit in the lowest byte */
+static uint32_t eight_digits (uint64_t w)
+{
+w -= 0x3030303030303030ULL;
+w = (w * 10) + (w >> 8);
+w = (((w & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+     (((w >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+return (uint32_t)w;
+}
+#endif
+
+
+/********************************************************
+* k2k_number: Converts a decimal number, such as        *
+*             "0.0167" or "+1.23456789E-03".            *
+* Input:    - start of text                             *
+*           - end of text (need not be 0-terminated)    *
+*           - where to store the value                  *
+* Return:   pointer behind the number, NULL if none     *
+********************************************************/
+const char *k2k_number (const char *p, const char *end, double *val)
+{
+const char *start = p, *q;
+uint64_t mant = 0;
+uint64_t w;
+int     neg = 0, digits = 0, scale = 0, exp = 0, eneg = 0;
+char    buf[64];
+double  d;
+
+if (p < end && (*p == '+' || *p == '-'))
+    neg = (*p++ == '-');
+
+while (p < end && ISDIGIT(*p))
+    {
+    if (digits < 19)
+        mant = mant * 10 + (*p - '0');
+    else
+        scale++;                /* digit is lost, fix up below */
+    digits++;
+    p++;
+    }
+if (p < end && *p == '.')
+    {
+    p++;
+#ifdef HAVE_SWAR
+    if (end - p >= 8 && digits <= 11)
+        {
+        memcpy (&w, p, 8);
+        if (is_eight_digits (w))
+            {
+            mant = mant * 100000000ULL + eight_digits (w);
+            digits += 8;
+            scale -= 8;
+            p += 8;
+            }
+        }
+#endif
+    while (p < end && ISDIGIT(*p))
+        {
+        if (digits < 19)
+            {
+            mant = mant * 10 + (*p - '0');
+            scale--;
+            }
+        digits++;
+        p++;
+        }
+    }
+if (!digits)
+    return NULL;
+
+if (p < end && (*p == 'E' || *p == 'e'))
+    {
+    q = p + 1;
+    if (q < end && (*q == '+' || *q == '-'))
+        eneg = (*q++ == '-');
+    if (q < end && ISDIGIT(*q))
+        {
+        while (q < end && ISDIGIT(*q))
+            {
+            if (exp < 10000)
+                exp = exp * 10 + (*q - '0');
+            q++;
+            }
+        p = q;
+        }
+    }
+if (eneg)
+    exp = -exp;
+exp += scale;
+
+/* --- exact when the mantissa fits 53 bits and 10^exp is exact --- */
+
+if (digits <= 19 && mant < (1ULL << 53) && exp >= -22 && exp <= 22)
+    {
+    d = (double)mant;
+    d = (exp < 0) ? d / pow10tab[-exp] : d * pow10tab[exp];
+    }
+else                            /* rare: let libc do it */
+    {
+    if (p - start >= (long)sizeof(buf))
+        return NULL;
+    memcpy (buf, start, p - start);
+    buf[p - start] = 0;
+    d = fabs (strtod (buf, NULL));
+    }
+*val = neg ? -d : d;
+return p;
+}
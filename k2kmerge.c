@@ -0,0 +1,295 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K M E R G E . C
+
+ Merges several k2000 data files onto one common timeline.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ All input files are read in parallel, one line at a time. The next
+ line to be written is picked from a binary min-heap holding the
+ current line of every file, keyed on absolute time (acquisition start
+ from the header plus the minutes column). Memory use is therefore
+ constant, regardless of the size of the files.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2kmerge.c k2kfile.c -lm -o k2kmerge
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>     /* getopt() */
+#include "k2kfile.h"
+
+#define ERR_FILE  4         /* error code */
+
+struct source
+{
+    struct k2kfile  f;
+    struct k2krec   r;          /* current line */
+    double  t;                  /* its absolute time, s since the Epoch */
+    char    last[K2K_MAXLEN+1]; /* last reading written (wide format) */
+    int     inrow;              /* 1 if that one is in the current row */
+};
+
+static struct source *src;
+static int  *heap, nheap;
+
+static void heap_down (int i);
+static int  advance (int i);
+static void print_value (FILE *out, const struct k2krec *r, int numeric);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kmerge [-h] [-l] [-e] [-v] [-o outfile] file1 file2 ..."
+"\n        -h       this help screen"
+"\n        -l       long format: one line per reading (default: one column per file)"
+"\n        -e       time as seconds since the Epoch (default: minutes since first start)"
+"\n        -v       write numeric values only (default: readings as in the files)"
+"\n        -o file  write to 'file' (default: standard output)\n\n";
+
+FILE    *out = stdout;
+int     key, i, n, do_long = 0, do_epoch = 0, do_numeric = 0;
+time_t  t0;
+double  trow = 0.0, t;
+int     have_row = 0;
+
+while ((key = getopt(argc, argv, "hlevo:")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 'l':
+            do_long = 1;
+            continue;
+        case 'e':
+            do_epoch = 1;
+            continue;
+        case 'v':
+            do_numeric = 1;
+            continue;
+        case 'o':
+            if (NULL == (out = fopen(optarg, "wt")))
+                {
+                fprintf(stderr, "Could not open '%s' for writing.\n", optarg);
+                return ERR_FILE;
+                }
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+n = argc - optind;
+if (n < 1)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify at least one data file.\n");
+    return 1;
+    }
+
+src  = calloc (n, sizeof(*src));
+heap = calloc (n, sizeof(*heap));
+if (!src || !heap)
+    {
+    fprintf (stderr, "Out of memory.\n");
+    return 1;
+    }
+
+/* --- open all files, find the earliest start --- */
+
+t0 = 0;
+for (i = 0; i < n; i++)
+    {
+    if (!k2k_open (&src[i].f, argv[optind+i]))
+        {
+        fprintf(stderr, "Could not open '%s' for reading.\n", argv[optind+i]);
+        return ERR_FILE;
+        }
+    if (!src[i].f.start)
+        {
+        fprintf(stderr, "'%s': no acquisition start time in header.\n", src[i].f.name);
+        return ERR_FILE;
+        }
+    if (!t0 || src[i].f.start < t0)
+        t0 = src[i].f.start;
+    strcpy (src[i].last, "NaN");
+    }
+
+/* --- write header --- */
+
+fprintf(out, "# k2kmerge " VERSION "\n");
+for (i = 0; i < n; i++)
+    fprintf(out, "# Source %d: %s (%s), start %s", i+1, src[i].f.name,
+            src[i].f.instrument, ctime(&src[i].f.start));
+fprintf(out, "# Acquisition start: %s", ctime(&t0));
+fprintf(out, "# %s", do_epoch ? "s" : "min");
+if (do_long)
+    fprintf(out, "\tsource\treadout\n");
+else
+    {
+    for (i = 0; i < n; i++)
+        fprintf(out, "\t%d", i+1);
+    fprintf(out, "\n");
+    }
+
+/* --- fill the heap with the first line of every file --- */
+
+nheap = 0;
+for (i = 0; i < n; i++)
+    if (advance (i))
+        heap[nheap++] = i;
+for (i = nheap/2 - 1; i >= 0; i--)
+    heap_down (i);
+
+/* --- merge --- */
+
+while (nheap > 0)
+    {
+    i = heap[0];
+    if (do_epoch)
+        t = src[i].t;
+    else
+        t = (src[i].t - (double)t0) / 60.0;
+
+    if (do_long)
+        {
+        fprintf(out, do_epoch ? "%.3f\t%d\t" : "%.4f\t%d\t", t, i+1);
+        print_value (out, &src[i].r, do_numeric);
+        fputc ('\n', out);
+        }
+    else
+        {
+        /* readings at the same time go into the same row, one of each
+           file at most (a burst has readings ms apart); the row keeps
+           the time of its first reading */
+        if (!have_row || src[i].inrow || fabs(t - trow) > (do_epoch ? 5e-4 : 5e-5))
+            {
+            if (have_row)
+                {
+                fprintf(out, do_epoch ? "%.3f" : "%.4f", trow);
+                for (key = 0; key < n; key++)
+                    {
+                    fprintf(out, "\t%s", src[key].last);
+                    src[key].inrow = 0;
+                    }
+                fputc ('\n', out);
+                }
+            trow = t;
+            have_row = 1;
+            }
+        src[i].inrow = 1;
+        if (do_numeric)
+            {
+            if (isnan(src[i].r.value))
+                strcpy (src[i].last, "NaN");
+            else
+                snprintf (src[i].last, sizeof(src[i].last), "%.9g", src[i].r.value);
+            }
+        else
+            strcpy (src[i].last, src[i].r.text);
+        }
+
+    if (!advance (i))               /* file exhausted: drop from heap */
+        heap[0] = heap[--nheap];
+    if (nheap > 0)
+        heap_down (0);
+    }
+
+if (have_row)
+    {
+    fprintf(out, do_epoch ? "%.3f" : "%.4f", trow);
+    for (key = 0; key < n; key++)
+        fprintf(out, "\t%s", src[key].last);
+    fputc ('\n', out);
+    }
+
+for (i = 0; i < n; i++)
+    k2k_close (&src[i].f);
+if (out != stdout)
+    fclose (out);
+free (src);
+free (heap);
+return 0;
+}
+
+
+/********************************************************
+* advance: Reads the next line of a source.             *
+* Input:    - index of source                           *
+* Return:   1 if OK, 0 at end of file                   *
+********************************************************/
+static int advance (int i)
+{
+if (!k2k_next (&src[i].f, &src[i].r))
+    return 0;
+src[i].t = (double)src[i].f.start + src[i].r.t * 60.0;
+return 1;
+}
+
+
+/* heap order: earlier time first, equal times in order of the command line */
+static int before (int a, int b)
+{
+if (src[a].t != src[b].t)
+    return src[a].t < src[b].t;
+return a < b;
+}
+
+/********************************************************
+* heap_down: Restores the heap property below node i.   *
+* Input:    - index into heap[]                         *
+* Return:   Nothing.                                    *
+********************************************************/
+static void heap_down (int i)
+{
+int c, tmp;
+
+for (;;)
+    {
+    c = 2*i + 1;
+    if (c >= nheap)
+        break;
+    if (c+1 < nheap && before (heap[c+1], heap[c]))
+        c++;
+    if (!before (heap[c], heap[i]))
+        break;
+    tmp = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+    i = c;
+    }
+}
+
+
+static void print_value (FILE *out, const struct k2krec *r, int numeric)
+{
+if (!numeric)
+    fputs (r->text, out);
+else if (isnan(r->value))
+    fputs ("NaN", out);
+else
+    fprintf (out, "%.9g", r->value);
+}
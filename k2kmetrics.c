@@ -0,0 +1,199 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K M E T R I C S . C
+
+ Acquisition health counters, exported in OpenMetrics text format.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ The metrics file is meant for a "textfile collector" such as the one of
+ the Prometheus node exporter: k2000 rewrites it every few seconds, and
+ the collector picks it up from there. It is written to a temporary
+ file first and then renamed, so the collector never sees half a file.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "k2kmetrics.h"
+
+static void counter (FILE *fp, const char *name, const char *help,
+                     const char *labels, unsigned long long v);
+static void summary (FILE *fp, const char *name, const char *help,
+                     const char *labels, const struct hist *h);
+
+
+/********************************************************
+* stats_snapshot: Takes a consistent copy of the        *
+*                 statistics, from any thread.          *
+* Input:    - where to copy to                          *
+*           - statistics being updated by the loop      *
+* Return:   Nothing.                                    *
+* Note:     Retries if the loop wrote in the meantime;  *
+*           the loop itself is never held up.           *
+********************************************************/
+void stats_snapshot (struct k2kstats *copy, const struct k2kstats *st)
+{
+unsigned s1, s2;
+
+for (;;)
+    {
+    s1 = atomic_load_explicit ((atomic_uint *)&st->seq, memory_order_acquire);
+    if (s1 & 1)
+        continue;
+    memcpy ((void *)copy, (const void *)st, sizeof(*copy));
+    atomic_thread_fence (memory_order_acquire);
+    s2 = atomic_load_explicit ((atomic_uint *)&st->seq, memory_order_relaxed);
+    if (s1 == s2)
+        return;
+    }
+}
+
+
+/********************************************************
+* metrics_labels: Builds the label set of all metrics.  *
+* Input:    - buffer and its size                       *
+*           - GPIB address                              *
+*           - data file name                            *
+* Return:   Nothing.                                    *
+********************************************************/
+void metrics_labels (char *buf, int len, int pad, const char *file)
+{
+int n;
+
+n = snprintf (buf, len, "address=\"%d\",file=\"", pad);
+for ( ; *file && n < len - 3; file++)   /* escape as OpenMetrics wants */
+    {
+    if (*file == '"' || *file == '\\')
+        buf[n++] = '\\';
+    buf[n++] = *file;
+    }
+buf[n++] = '"';
+buf[n] = 0;
+}
+
+
+/********************************************************
+* metrics_write: Writes all metrics.                    *
+* Input:    - file to write to                          *
+*           - pointer to statistics                     *
+*           - label set, from metrics_labels()          *
+*           - current time, s since the Epoch           *
+* Return:   Nothing.                                    *
+********************************************************/
+void metrics_write (FILE *fp, const struct k2kstats *st, const char *labels, double now)
+{
+char    *end;
+double  v;
+
+counter (fp, "k2000_samples", "Readings acquired.", labels, st->samples);
+counter (fp, "k2000_overruns", "Sampling intervals missed.", labels, st->overruns);
+counter (fp, "k2000_gpib_errors", "GPIB errors, including timeouts.", labels, st->errors);
+counter (fp, "k2000_gpib_timeouts", "GPIB timeouts.", labels, st->timeouts);
+counter (fp, "k2000_written_bytes", "Bytes written to the data file.", labels, st->bytes);
+counter (fp, "k2000_recoveries", "Bus errors recovered from without stopping.", labels, st->recoveries);
+fprintf(fp, "# TYPE k2000_recovery_seconds counter\n"
+            "# HELP k2000_recovery_seconds Time lost to recoveries (gaps in the data).\n");
+fprintf(fp, "k2000_recovery_seconds_total{%s} %.3f\n", labels, st->recovery_ns / 1e9);
+counter (fp, "k2000_bus_stalls", "Hanging transactions aborted by the watchdog.", labels, st->stalls);
+fprintf(fp, "# TYPE k2000_bus_stall_seconds counter\n"
+            "# HELP k2000_bus_stall_seconds Time until hanging transactions returned.\n");
+fprintf(fp, "k2000_bus_stall_seconds_total{%s} %.3f\n", labels, st->stall_ns / 1e9);
+counter (fp, "k2000_instrument_errors", "Errors read from the instrument's error queue.", labels, st->inst_errors);
+
+fprintf(fp, "# TYPE k2000_sample_rate_hertz gauge\n"
+            "# HELP k2000_sample_rate_hertz Achieved sampling rate since start.\n");
+fprintf(fp, "k2000_sample_rate_hertz{%s} %.6g\n", labels,
+        (now > st->start) ? st->samples / (now - st->start) : 0.0);
+if (st->samples)
+    {
+    fprintf(fp, "# TYPE k2000_first_sample_seconds gauge\n"
+                "# HELP k2000_first_sample_seconds Time from program start to the first reading.\n");
+    fprintf(fp, "k2000_first_sample_seconds{%s} %.6f\n", labels, st->first_ns / 1e9);
+    }
+
+/* the reading as sent by the instrument: value and unit suffix */
+v = strtod (st->last, &end);
+if (end == st->last || fabs(v) >= 9.9e37)
+    v = NAN;
+fprintf(fp, "# TYPE k2000_last_reading gauge\n"
+            "# HELP k2000_last_reading Most recent reading, NaN if overflow.\n");
+fprintf(fp, "k2000_last_reading{%s,unit=\"%.16s\"} ", labels, (end == st->last) ? "" : end);
+if (isnan (v))
+    fprintf(fp, "NaN\n");
+else
+    fprintf(fp, "%.10g\n", v);
+fprintf(fp, "# TYPE k2000_last_reading_timestamp_seconds gauge\n"
+            "# HELP k2000_last_reading_timestamp_seconds Time of the most recent reading.\n");
+fprintf(fp, "k2000_last_reading_timestamp_seconds{%s} %.3f\n", labels, st->last_time);
+
+summary (fp, "k2000_loop_period_seconds", "Time from one trigger to the next.", labels, &st->period);
+summary (fp, "k2000_bus_round_trip_seconds", "Trigger written until reading received.", labels, &st->bus);
+summary (fp, "k2000_sample_to_file_seconds", "Reading received until handed to the OS.", labels, &st->disk);
+fprintf(fp, "# EOF\n");
+}
+
+
+/********************************************************
+* metrics_file: Replaces the metrics file atomically.   *
+* Input:    - file name                                 *
+*           - as for metrics_write()                    *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int metrics_file (const char *path, const struct k2kstats *st, const char *labels, double now)
+{
+char    tmp[512];
+FILE    *fp;
+int     ok;
+
+snprintf (tmp, sizeof(tmp), "%s.tmp", path);
+if (NULL == (fp = fopen (tmp, "wt")))
+    return 0;
+metrics_write (fp, st, labels, now);
+ok = !ferror (fp);
+if (fclose (fp))
+    ok = 0;
+if (!ok || rename (tmp, path))
+    {
+    unlink (tmp);
+    return 0;
+    }
+return 1;
+}
+
+
+static void counter (FILE *fp, const char *name, const char *help,
+                     const char *labels, unsigned long long v)
+{
+fprintf(fp, "# TYPE %s counter\n# HELP %s %s\n%s_total{%s} %llu\n",
+        name, name, help, name, labels, v);
+}
+
+static void summary (FILE *fp, const char *name, const char *help,
+                     const char *labels, const struct hist *h)
+{
+static const double q[] = {0.5, 0.9, 0.99, 0.999};
+int i;
+
+fprintf(fp, "# TYPE %s summary\n# HELP %s %s\n", name, name, help);
+for (i = 0; i < 4; i++)
+    fprintf(fp, "%s{%s,quantile=\"%g\"} %.9f\n", name, labels, q[i], hist_quantile (h, q[i]) / 1e9);
+fprintf(fp, "%s_count{%s} %llu\n", name, labels, h->count);
+fprintf(fp, "%s_sum{%s} %.9f\n", name, labels, h->sum / 1e9);
+}
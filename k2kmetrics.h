@@ -0,0 +1,76 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K M E T R I C S . H
+
+ Acquisition health counters, exported in OpenMetrics text format.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KMETRICS_H
+#define K2KMETRICS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "k2khist.h"
+
+#define LATEST  16          /* readings kept for /latest */
+
+/* --- Written by the acquisition loop only. Other threads must take a
+       copy with stats_snapshot(); the writer brackets its updates with
+       stats_begin()/stats_end() (a "seqlock": the writer never waits) */
+
+struct k2kstats
+{
+    atomic_uint seq;                /* odd while being updated */
+    unsigned long long samples;     /* readings acquired */
+    unsigned long long overruns;    /* sampling interval missed */
+    unsigned long long errors;      /* GPIB errors, including timeouts */
+    unsigned long long timeouts;
+    unsigned long long bytes;       /* written to data file */
+    unsigned long long recoveries;  /* bus errors recovered from */
+    unsigned long long recovery_ns; /* ... time lost to them */
+    unsigned long long stalls;      /* hanging transactions (k2kdog.c) */
+    unsigned long long stall_ns;    /* ... time until they returned */
+    unsigned long long inst_errors; /* read from the instrument's queue */
+    unsigned long long first_ns;    /* from start to the first reading */
+    double  start;                  /* acquisition start, s since the Epoch */
+    double  last_time;              /* time of last reading, s since the Epoch */
+    char    last[64];               /* last reading, as sent by instrument */
+    struct hist period;             /* from one trigger to the next */
+    struct hist bus;                /* trigger written ... reading received */
+    struct hist disk;               /* reading received ... handed to the OS */
+    struct
+    {
+        double  time;               /* s since the Epoch */
+        char    text[32];
+    } latest[LATEST];               /* ring, most recent at samples-1 */
+};
+
+static inline void stats_begin (struct k2kstats *st)
+{
+atomic_store_explicit (&st->seq, atomic_load_explicit (&st->seq, memory_order_relaxed) + 1,
+                       memory_order_relaxed);
+atomic_thread_fence (memory_order_release);
+}
+
+static inline void stats_end (struct k2kstats *st)
+{
+atomic_store_explicit (&st->seq, atomic_load_explicit (&st->seq, memory_order_relaxed) + 1,
+                       memory_order_release);
+}
+
+void    stats_snapshot (struct k2kstats *copy, const struct k2kstats *st);
+
+void    metrics_write (FILE *fp, const struct k2kstats *st, const char *labels, double now);
+int     metrics_file (const char *path, const struct k2kstats *st, const char *labels, double now);
+void    metrics_labels (char *buf, int len, int pad, const char *file);
+
+#endif
@@ -0,0 +1,1136 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K P A C K . C
+
+ Compacts finished k2000 data files into a compressed binary archive,
+ and converts them back.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Encoding (lossless, byte by byte):
+
+ Every line is split into TAB-separated fields. A field which starts
+ with a decimal number, such as "0.0167" or "+1.23456789E-03VDC", is
+ stored as the integer of its digits (1234567890) plus a "shape" which
+ says how to print it back: sign, number of digits before and after the
+ point, and the literal rest ("E-03VDC"). The shape of the whole line is
+ kept in a dictionary, so a data line shrinks to a shape number and one
+ zig-zag varint per number: the difference to the previous line for the
+ readings, the difference of the differences for the time column (which
+ is then mostly 0). Anything else (header, comments) is stored as is.
+
+ Typical data lines of 30 bytes end up as 5...7 bytes.
+
+ File layout:
+
+    "K2Z\1"
+    block, block, ...       (varint #lines, varint #bytes, records)
+    summary                 (sizes, checksum, counts, time span, min/max)
+    shape dictionary
+    time index              (offset, first line, first time per block)
+    trailer offset (8 bytes) and "K2Z\1"
+
+ Blocks can be decoded on their own, so the time index gives quick
+ access to any part of a long file.
+
+ Compaction runs in parallel worker processes at lowest CPU and idle I/O
+ priority. Each archive is decoded again and compared with the original
+ before it is renamed into place; only then may the original be removed.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2kpack.c k2kfile.c -lm -o k2kpack
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>     /* PATH_MAX */
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "k2kfile.h"
+
+#define ERR_FILE  4         /* error code */
+
+#define MAGIC       "K2Z\1"
+#define BLOCKLINES  4096    /* lines per block */
+#define MAXFIELDS   16      /* numeric predictors per line */
+#define MAXDIGITS   18      /* fits into int64 */
+#define MAXSHAPES   4096
+#define SHAPEHASH   8192    /* must be power of 2, > MAXSHAPES */
+#define NUMBER      '\1'    /* marks a number in a shape */
+#define NOPOINT     0xff
+
+/* --- growable byte buffer --- */
+
+struct buf
+{
+    uint8_t *p;
+    size_t  len, cap;
+};
+
+/* --- shape dictionary --- */
+
+struct shapes
+{
+    struct buf  s[MAXSHAPES];
+    int     n;
+    int     hash[SHAPEHASH];    /* index+1, 0 = empty */
+};
+
+/* --- what we know about a file --- */
+
+struct summary
+{
+    uint64_t size;          /* original size in bytes */
+    uint64_t hash;          /* FNV-1a of the original */
+    uint64_t lines;
+    uint64_t records;       /* data lines */
+    uint64_t overflow;
+    uint64_t head;          /* lines before the first data line */
+    double  tfirst, tlast;  /* minutes */
+    double  vmin, vmax, vsum;
+    uint64_t newline;       /* 1 if the last line ends with '\n' */
+};
+
+struct index
+{
+    uint64_t offset;        /* of block in archive */
+    uint64_t line;          /* first line number, from 0 */
+    double  t;              /* time of first data line, NAN if none */
+};
+
+/* --- where decoded text goes: file, or compare with original --- */
+
+struct sink
+{
+    FILE    *fp;
+    const char *cmp;
+    size_t  cmplen, pos;
+    int     ok;
+    uint64_t hash;
+    double  tmin, tmax;     /* time range to write */
+};
+
+static int      verbose = 0;
+
+static void     put_byte (struct buf *b, uint8_t c);
+static void     put_bytes (struct buf *b, const void *p, size_t n);
+static void     put_varint (struct buf *b, uint64_t v);
+static void     put_u64 (struct buf *b, uint64_t v);
+static void     put_double (struct buf *b, double d);
+static int      get_varint (const uint8_t **p, const uint8_t *end, uint64_t *v);
+static uint64_t get_u64 (const uint8_t *p);
+static double   get_double (const uint8_t *p);
+static uint64_t fnv (uint64_t h, const void *p, size_t n);
+
+static int      encode (const char *in, size_t len, FILE *out);
+static int      decode (const uint8_t *z, size_t zlen, struct sink *s, int info);
+static int      pack_file (const char *name, int do_force, int do_remove);
+static int      unpack_file (const char *name, FILE *out, double tmin, double tmax, int info);
+static int      run_parallel (char **names, int n, int jobs, int do_force, int do_remove);
+static void     low_priority (void);
+static int      scan_dir (const char *dir, const char *suffix, int jobs, int do_remove);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kpack [-h] [-j n] [-f] [-r] [-v] file.dat ..."
+"\n        k2kpack -x [-b min] [-e min] [-o outfile] file.k2z"
+"\n        k2kpack -i file.k2z"
+"\n        k2kpack -d dir [-p sec] [-s suffix] [-j n] [-r]"
+"\n        -h       this help screen"
+"\n        -j n     use n parallel workers (default is 2)"
+"\n        -f       also pack files without 'Acquisition stop' line"
+"\n        -r       remove original after successful verification"
+"\n        -v       verbose"
+"\n        -x       convert archive back to text"
+"\n        -b/-e    with -x: only from/until this time (min), with header"
+"\n        -o file  with -x: write to 'file' (default: standard output)"
+"\n        -i       show summary and time index of archive"
+"\n        -d dir   daemon: look for finished data files in 'dir'"
+"\n        -p sec   daemon: scan interval (default is 60)"
+"\n        -s suf   daemon: data file suffix (default is .dat)\n\n";
+
+FILE    *out = stdout;
+int     key, jobs = 2, do_force = 0, do_remove = 0, extract = 0, info = 0, period = 60;
+double  tmin = -HUGE_VAL, tmax = HUGE_VAL;
+char    *dir = NULL, *suffix = ".dat";
+
+while ((key = getopt(argc, argv, "hj:frvxb:e:o:id:p:s:")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 'j':
+            jobs = atoi (optarg);
+            if (jobs < 1)
+                jobs = 1;
+            continue;
+        case 'f':
+            do_force = 1;
+            continue;
+        case 'r':
+            do_remove = 1;
+            continue;
+        case 'v':
+            verbose = 1;
+            continue;
+        case 'x':
+            extract = 1;
+            continue;
+        case 'b':
+            tmin = atof (optarg);
+            continue;
+        case 'e':
+            tmax = atof (optarg);
+            continue;
+        case 'o':
+            if (NULL == (out = fopen(optarg, "wt")))
+                {
+                fprintf(stderr, "Could not open '%s' for writing.\n", optarg);
+                return ERR_FILE;
+                }
+            continue;
+        case 'i':
+            info = 1;
+            continue;
+        case 'd':
+            dir = optarg;
+            continue;
+        case 'p':
+            period = atoi (optarg);
+            if (period < 1)
+                period = 1;
+            continue;
+        case 's':
+            suffix = optarg;
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+if (dir)                    /* daemon mode: never returns */
+    {
+    low_priority ();
+    for (;;)
+        {
+        scan_dir (dir, suffix, jobs, do_remove);
+        sleep (period);
+        }
+    }
+
+if (argv[optind] == NULL)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify a file.\n");
+    return 1;
+    }
+
+if (extract || info)
+    return unpack_file (argv[optind], out, tmin, tmax, info) ? 0 : ERR_FILE;
+
+low_priority ();
+return run_parallel (argv + optind, argc - optind, jobs, do_force, do_remove) ? 0 : ERR_FILE;
+}
+
+
+/* ------------------------------------------------------------------ */
+/*      low level: bytes, varints, checksum                           */
+/* ------------------------------------------------------------------ */
+
+static void put_byte (struct buf *b, uint8_t c)
+{
+put_bytes (b, &c, 1);
+}
+
+static void put_bytes (struct buf *b, const void *p, size_t n)
+{
+if (b->len + n > b->cap)
+    {
+    b->cap = (b->len + n) * 2 + 256;
+    if (NULL == (b->p = realloc (b->p, b->cap)))
+        {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+        }
+    }
+memcpy (b->p + b->len, p, n);
+b->len += n;
+}
+
+static void put_varint (struct buf *b, uint64_t v)
+{
+while (v >= 0x80)
+    {
+    put_byte (b, (uint8_t)(v | 0x80));
+    v >>= 7;
+    }
+put_byte (b, (uint8_t)v);
+}
+
+static void put_u64 (struct buf *b, uint64_t v)
+{
+uint8_t c[8];
+int     i;
+
+for (i = 0; i < 8; i++)
+    c[i] = (uint8_t)(v >> (8*i));
+put_bytes (b, c, 8);
+}
+
+static void put_double (struct buf *b, double d)
+{
+uint64_t v;
+
+memcpy (&v, &d, 8);
+put_u64 (b, v);
+}
+
+static int get_varint (const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+int     shift = 0;
+
+*v = 0;
+while (*p < end && shift < 64)
+    {
+    *v |= (uint64_t)(**p & 0x7f) << shift;
+    if (!(*(*p)++ & 0x80))
+        return 1;
+    shift += 7;
+    }
+return 0;
+}
+
+static uint64_t get_u64 (const uint8_t *p)
+{
+uint64_t v = 0;
+int     i;
+
+for (i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+return v;
+}
+
+static double get_double (const uint8_t *p)
+{
+uint64_t v = get_u64 (p);
+double  d;
+
+memcpy (&d, &v, 8);
+return d;
+}
+
+#define ZIGZAG(v)   (((uint64_t)(v) << 1) ^ (uint64_t)((int64_t)(v) >> 63))
+#define UNZIGZAG(u) ((int64_t)((u) >> 1) ^ -(int64_t)((u) & 1))
+
+static uint64_t fnv (uint64_t h, const void *p, size_t n)
+{
+const uint8_t *c = p;
+
+while (n--)
+    {
+    h ^= *c++;
+    h *= 0x100000001b3ULL;
+    }
+return h;
+}
+#define FNV_INIT    0xcbf29ce484222325ULL
+
+
+/* ------------------------------------------------------------------ */
+/*      encoder                                                       */
+/* ------------------------------------------------------------------ */
+
+/********************************************************
+* shape_id: Looks up (or adds) a shape.                 *
+* Input:    - dictionary                                *
+*           - shape bytes                               *
+* Return:   index, -1 if dictionary is full             *
+********************************************************/
+static int shape_id (struct shapes *d, const struct buf *s)
+{
+unsigned h = (unsigned)fnv (FNV_INIT, s->p, s->len) & (SHAPEHASH-1);
+int     i;
+
+while ((i = d->hash[h]) != 0)
+    {
+    i--;
+    if (d->s[i].len == s->len && !memcmp (d->s[i].p, s->p, s->len))
+        return i;
+    h = (h + 1) & (SHAPEHASH-1);
+    }
+if (d->n >= MAXSHAPES)
+    return -1;
+memset (&d->s[d->n], 0, sizeof(struct buf));
+put_bytes (&d->s[d->n], s->p, s->len);
+d->hash[h] = ++d->n;
+return d->n - 1;
+}
+
+/********************************************************
+* split_line: Splits a line into shape and numbers.     *
+* Input:    - line (without '\n') and its length        *
+*           - buffer for the shape                      *
+*           - array for the numbers                     *
+* Return:   number of numbers, -1 if not representable  *
+********************************************************/
+static int split_line (const char *p, size_t len, struct buf *shape, int64_t *num)
+{
+const char *end = p + len, *f, *q;
+const char *c;
+int     n = 0, ni, nf, nd, neg, sign;
+uint64_t v;
+uint8_t d[4];
+
+shape->len = 0;
+if (memchr (p, NUMBER, len))
+    return -1;
+
+for (f = p; f <= end; f = q + 1)
+    {
+    if (f > p)
+        put_byte (shape, '\t');
+    if (NULL == (q = memchr (f, '\t', end - f)))
+        q = end;
+
+    /* [+-]digits[.digits] at start of field? */
+    c = f;
+    sign = neg = 0;
+    if (c < q && (*c == '+' || *c == '-'))
+        {
+        sign = 1;
+        neg = (*c++ == '-');
+        }
+    v = 0;
+    for (ni = 0; c < q && *c >= '0' && *c <= '9'; ni++, c++)
+        v = v * 10 + (*c - '0');
+    nf = NOPOINT;
+    if (c < q && *c == '.')
+        for (c++, nf = 0; c < q && *c >= '0' && *c <= '9'; nf++, c++)
+            v = v * 10 + (*c - '0');
+    nd = ni + (nf == NOPOINT ? 0 : nf);
+    if (nd == 0 || nd > MAXDIGITS || (neg && v == 0) || n >= MAXFIELDS)
+        {
+        put_bytes (shape, f, q - f);        /* plain text */
+        continue;
+        }
+    d[0] = NUMBER;
+    d[1] = sign ? '+' : 'n';
+    d[2] = (uint8_t)ni;
+    d[3] = (uint8_t)nf;
+    put_bytes (shape, d, 4);
+    put_bytes (shape, c, q - c);            /* literal rest */
+    num[n++] = neg ? -(int64_t)v : (int64_t)v;
+    }
+return n;
+}
+
+/********************************************************
+* encode: Compacts a text file.                         *
+* Input:    - text and its length                       *
+*           - output file                               *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+static int encode (const char *in, size_t len, FILE *out)
+{
+static struct shapes dict;
+struct buf blk = {0}, rec = {0}, shape = {0}, trailer = {0};
+struct buf idx = {0};
+struct summary sum;
+struct k2krec r;
+char    line[K2K_MAXLEN+1];
+const char *p = in, *end = in + len, *nl;
+int64_t num[MAXFIELDS], prev[MAXFIELDS], pdelta[MAXFIELDS], dlt;
+uint64_t nblk = 0, blines = 0, offset = 4;
+size_t  ll;
+int     n, i, id;
+double  tblk = NAN;
+
+memset (&dict, 0, sizeof(dict));
+memset (&sum, 0, sizeof(sum));
+sum.size = len;
+sum.hash = fnv (FNV_INIT, in, len);
+sum.tfirst = sum.tlast = NAN;
+sum.vmin = HUGE_VAL;
+sum.vmax = -HUGE_VAL;
+sum.newline = (len == 0 || in[len-1] == '\n');
+
+fwrite (MAGIC, 1, 4, out);
+
+while (p < end || blines)
+    {
+    /* --- close block when full or at end of input --- */
+    if (blines == BLOCKLINES || (p >= end && blines))
+        {
+        put_u64 (&idx, offset);
+        put_u64 (&idx, sum.lines - blines);
+        put_double (&idx, tblk);
+        nblk++;
+
+        rec.len = 0;
+        put_varint (&rec, blines);
+        put_varint (&rec, blk.len);
+        fwrite (rec.p, 1, rec.len, out);
+        fwrite (blk.p, 1, blk.len, out);
+        offset += rec.len + blk.len;
+        blk.len = 0;
+        blines = 0;
+        tblk = NAN;
+        continue;
+        }
+    if (blines == 0)            /* every block starts from scratch */
+        {
+        memset (prev, 0, sizeof(prev));
+        memset (pdelta, 0, sizeof(pdelta));
+        }
+
+    nl = memchr (p, '\n', end - p);
+    ll = (nl ? nl : end) - p;
+
+    n = split_line (p, ll, &shape, num);
+    id = (n > 0) ? shape_id (&dict, &shape) : -1;   /* text only: as is */
+    if (n > 0 && id >= 0)
+        {
+        put_varint (&blk, (uint64_t)id + 1);
+        for (i = 0; i < n; i++)
+            {
+            dlt = num[i] - prev[i];
+            if (i == 0)                     /* time: delta of delta */
+                {
+                put_varint (&blk, ZIGZAG(dlt - pdelta[i]));
+                pdelta[i] = dlt;
+                }
+            else
+                put_varint (&blk, ZIGZAG(dlt));
+            prev[i] = num[i];
+            }
+        }
+    else
+        {
+        put_varint (&blk, 0);
+        put_varint (&blk, ll);
+        put_bytes (&blk, p, ll);
+        }
+
+    /* --- summary: same view of the line as the other tools --- */
+    if (ll <= K2K_MAXLEN && *p != '#')
+        {
+        memcpy (line, p, ll);
+        line[ll] = 0;
+        if (k2k_parse (line, &r))
+            {
+            if (!sum.records)
+                {
+                sum.head = sum.lines;
+                sum.tfirst = r.t;
+                }
+            if (isnan (tblk))
+                tblk = r.t;
+            sum.tlast = r.t;
+            sum.records++;
+            if (isnan (r.value))
+                sum.overflow++;
+            else
+                {
+                if (r.value < sum.vmin)
+                    sum.vmin = r.value;
+                if (r.value > sum.vmax)
+                    sum.vmax = r.value;
+                sum.vsum += r.value;
+                }
+            }
+        }
+
+    sum.lines++;
+    blines++;
+    p = nl ? nl + 1 : end;
+    }
+if (!sum.records)
+    sum.head = sum.lines;
+
+/* --- trailer: summary, shapes, index --- */
+
+put_u64 (&trailer, sum.size);
+put_u64 (&trailer, sum.hash);
+put_u64 (&trailer, sum.lines);
+put_u64 (&trailer, sum.records);
+put_u64 (&trailer, sum.overflow);
+put_u64 (&trailer, sum.head);
+put_double (&trailer, sum.tfirst);
+put_double (&trailer, sum.tlast);
+put_double (&trailer, sum.vmin);
+put_double (&trailer, sum.vmax);
+put_double (&trailer, sum.vsum);
+put_u64 (&trailer, sum.newline);
+put_varint (&trailer, dict.n);
+for (i = 0; i < dict.n; i++)
+    {
+    put_varint (&trailer, dict.s[i].len);
+    put_bytes (&trailer, dict.s[i].p, dict.s[i].len);
+    free (dict.s[i].p);
+    }
+put_varint (&trailer, nblk);
+put_bytes (&trailer, idx.p, idx.len);
+put_u64 (&trailer, offset);         /* where the trailer starts */
+put_bytes (&trailer, MAGIC, 4);
+fwrite (trailer.p, 1, trailer.len, out);
+
+free (blk.p);
+free (rec.p);
+free (shape.p);
+free (trailer.p);
+free (idx.p);
+return !ferror (out);
+}
+
+
+/* ------------------------------------------------------------------ */
+/*      decoder                                                       */
+/* ------------------------------------------------------------------ */
+
+static void emit (struct sink *s, const char *p, size_t n)
+{
+s->hash = fnv (s->hash, p, n);
+if (s->fp)
+    fwrite (p, 1, n, s->fp);
+if (s->cmp)
+    {
+    if (s->pos + n > s->cmplen || memcmp (s->cmp + s->pos, p, n))
+        s->ok = 0;
+    s->pos += n;
+    }
+}
+
+/********************************************************
+* print_line: Rebuilds a line from shape and numbers.   *
+* Input:    - shape, its length                         *
+*           - numbers                                   *
+*           - output buffer (large enough)              *
+* Return:   length of line                              *
+********************************************************/
+static size_t print_line (const uint8_t *sh, size_t len, const int64_t *num, char *out)
+{
+const uint8_t *end = sh + len;
+char    digits[24], *o = out;
+int     k = 0, ni, nf, nd, w;
+uint64_t a;
+
+while (sh < end)
+    {
+    if (*sh != NUMBER)
+        {
+        *o++ = *sh++;
+        continue;
+        }
+    ni = sh[2];
+    nf = (sh[3] == NOPOINT) ? -1 : sh[3];
+    if (sh[1] == '+')
+        *o++ = (num[k] < 0) ? '-' : '+';
+    a = (num[k] < 0) ? (uint64_t)(-num[k]) : (uint64_t)num[k];
+    k++;
+    nd = ni + (nf > 0 ? nf : 0);
+    for (w = nd - 1; w >= 0; w--)
+        {
+        digits[w] = '0' + (char)(a % 10);
+        a /= 10;
+        }
+    memcpy (o, digits, ni);
+    o += ni;
+    if (nf >= 0)
+        {
+        *o++ = '.';
+        memcpy (o, digits + ni, nf);
+        o += nf;
+        }
+    sh += 4;
+    }
+return o - out;
+}
+
+/********************************************************
+* decode: Converts an archive back to text.             *
+* Input:    - archive and its length                    *
+*           - where the text goes                       *
+*           - 1: only print summary and index           *
+* Return:   1 if OK, 0 if archive is damaged            *
+********************************************************/
+static int decode (const uint8_t *z, size_t zlen, struct sink *s, int info)
+{
+struct summary sum;
+struct index ix;
+struct k2krec r;
+const uint8_t *p, *end, *tp, *te, **shp = NULL;
+const char *lp;
+size_t  *shlen = NULL, maxshape = 0, ll;
+int     *shnum = NULL;
+uint64_t nshape, nblk, blines, bbytes, id, len, u, line, b, first;
+int64_t num[MAXFIELDS], prev[MAXFIELDS], pdelta[MAXFIELDS];
+char    *text = NULL, tline[K2K_MAXLEN+1];
+int     i, n, ok = 0, ranged, inside = 0;
+double  t;
+
+if (zlen < 16 || memcmp (z, MAGIC, 4) || memcmp (z + zlen - 4, MAGIC, 4))
+    return 0;
+/* lengths and offsets are checked as numbers, before they are added
+   to a pointer: in a damaged archive they can be anything */
+u = get_u64 (z + zlen - 12);
+if (u < 4 || u > zlen - 12 || zlen - 12 - u < 12 * 8)
+    return 0;
+tp = z + u;
+te = z + zlen - 12;
+
+sum.size     = get_u64 (tp);
+sum.hash     = get_u64 (tp + 8);
+sum.lines    = get_u64 (tp + 16);
+sum.records  = get_u64 (tp + 24);
+sum.overflow = get_u64 (tp + 32);
+sum.head     = get_u64 (tp + 40);
+sum.tfirst   = get_double (tp + 48);
+sum.tlast    = get_double (tp + 56);
+sum.vmin     = get_double (tp + 64);
+sum.vmax     = get_double (tp + 72);
+sum.vsum     = get_double (tp + 80);
+sum.newline  = get_u64 (tp + 88);
+tp += 96;
+
+/* --- shape dictionary, and how many numbers each shape holds; no
+       more than the encoder writes, print_line() relies on it --- */
+
+if (!get_varint (&tp, te, &nshape) || nshape > MAXSHAPES)
+    return 0;
+shp = calloc (nshape + 1, sizeof(*shp));
+shlen = calloc (nshape + 1, sizeof(*shlen));
+shnum = calloc (nshape + 1, sizeof(*shnum));
+for (u = 0; u < nshape; u++)
+    {
+    if (!get_varint (&tp, te, &len) || len > (uint64_t)(te - tp))
+        goto done;
+    shp[u] = tp;
+    shlen[u] = len;
+    for (i = 0; i < (int)len; i++)
+        if (tp[i] == NUMBER)
+            {
+            if (i + 3 >= (int)len || ++shnum[u] > MAXFIELDS ||
+                tp[i+2] + (tp[i+3] == NOPOINT ? 0 : tp[i+3]) > MAXDIGITS)
+                goto done;
+            i += 3;
+            }
+    if (len > maxshape)
+        maxshape = len;
+    tp += len;
+    }
+if (!get_varint (&tp, te, &nblk) || nblk > (uint64_t)(te - tp) / 24)
+    goto done;
+
+if (info)
+    {
+    printf("      Original :  %lu bytes, %lu lines\n", (unsigned long)sum.size, (unsigned long)sum.lines);
+    printf("       Archive :  %lu bytes (%.1f%%)\n", (unsigned long)zlen,
+           sum.size ? 100.0 * zlen / sum.size : 0.0);
+    printf("       Samples :  %lu (%lu OVERFLOW)\n", (unsigned long)sum.records, (unsigned long)sum.overflow);
+    printf("          Time :  %.4f ... %.4f min\n", sum.tfirst, sum.tlast);
+    if (sum.records > sum.overflow)
+        printf("  Min/Mean/Max :  %.9g / %.9g / %.9g\n", sum.vmin,
+               sum.vsum / (sum.records - sum.overflow), sum.vmax);
+    printf("        Shapes :  %lu\n", (unsigned long)nshape);
+    printf("        Blocks :  %lu\n", (unsigned long)nblk);
+    for (b = 0; b < nblk; b++)
+        printf("    %6lu  offset %10lu  line %10lu  t %.4f\n", (unsigned long)b,
+               (unsigned long)get_u64 (tp + 24*b), (unsigned long)get_u64 (tp + 24*b + 8),
+               get_double (tp + 24*b + 16));
+    ok = 1;
+    goto done;
+    }
+
+if (NULL == (text = malloc (maxshape + MAXFIELDS * 24 + 2)))
+    goto done;
+
+/* --- with a time range, skip ahead via the index --- */
+
+ranged = (s->tmin > -HUGE_VAL || s->tmax < HUGE_VAL);
+first = 0;
+if (s->tmin > -HUGE_VAL)
+    for (b = 1; b < nblk; b++)
+        {
+        t = get_double (tp + 24*b + 16);
+        if (!isnan (t) && t <= s->tmin)
+            first = b;
+        }
+
+s->hash = FNV_INIT;
+for (b = 0; b < nblk; b++)
+    {
+    ix.offset = get_u64 (tp + 24*b);
+    ix.line = get_u64 (tp + 24*b + 8);
+    if (b < first && ix.line >= sum.head)       /* nothing of interest */
+        continue;
+    if (ix.offset >= zlen)
+        goto done;
+
+    p = z + ix.offset;
+    end = z + zlen;
+    if (!get_varint (&p, end, &blines) || !get_varint (&p, end, &bbytes) ||
+        bbytes > (uint64_t)(end - p))
+        goto done;
+    end = p + bbytes;
+    memset (prev, 0, sizeof(prev));
+    memset (pdelta, 0, sizeof(pdelta));
+
+    for (line = ix.line; line < ix.line + blines; line++)
+        {
+        if (!get_varint (&p, end, &id))
+            goto done;
+        if (id == 0)                            /* stored as is */
+            {
+            if (!get_varint (&p, end, &len) || len > (uint64_t)(end - p))
+                goto done;
+            lp = (const char *)p;
+            ll = len;
+            p += len;
+            }
+        else
+            {
+            if (id > nshape)
+                goto done;
+            n = shnum[id-1];
+            for (i = 0; i < n; i++)
+                {
+                if (!get_varint (&p, end, &u))
+                    goto done;
+                if (i == 0)
+                    {
+                    pdelta[0] += UNZIGZAG(u);
+                    num[0] = prev[0] + pdelta[0];
+                    }
+                else
+                    num[i] = prev[i] + UNZIGZAG(u);
+                prev[i] = num[i];
+                }
+            ll = print_line (shp[id-1], shlen[id-1], num, text);
+            lp = text;
+            }
+
+        /* data lines by time; the others (comments, markers, the stop
+           line) where they are, i.e. once the range has begun */
+        if (ranged && line >= sum.head)
+            {
+            n = 0;
+            if (ll <= K2K_MAXLEN && *lp != '#')
+                {
+                memcpy (tline, lp, ll);
+                tline[ll] = 0;
+                n = k2k_parse (tline, &r);
+                }
+            if (n)
+                {
+                if (r.t < s->tmin)
+                    continue;
+                if (r.t > s->tmax)
+                    {
+                    ok = 1;
+                    goto done;
+                    }
+                inside = 1;
+                }
+            else if (!inside)
+                continue;
+            }
+        emit (s, lp, ll);
+        if (line + 1 < sum.lines || sum.newline)
+            emit (s, "\n", 1);
+        }
+    }
+
+ok = 1;
+if (!ranged && s->hash != sum.hash)
+    {
+    fprintf (stderr, "Checksum mismatch.\n");
+    ok = 0;
+    }
+
+done:
+free (shp);
+free (shlen);
+free (shnum);
+free (text);
+return ok;
+}
+
+
+/* ------------------------------------------------------------------ */
+/*      files and workers                                             */
+/* ------------------------------------------------------------------ */
+
+/* maps a whole file read-only; size 0 gives a valid, empty map */
+static const char *map_file (const char *name, size_t *len)
+{
+struct stat st;
+void    *p;
+int     fd;
+
+if ((fd = open (name, O_RDONLY)) < 0)
+    return NULL;
+if (fstat (fd, &st) < 0)
+    {
+    close (fd);
+    return NULL;
+    }
+*len = st.st_size;
+p = mmap (NULL, *len ? *len : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+close (fd);
+if (p == MAP_FAILED)
+    return NULL;
+madvise (p, *len ? *len : 1, MADV_SEQUENTIAL);
+return p;
+}
+
+/* has k2000 finished writing this file? */
+static int finished (const char *p, size_t len)
+{
+size_t  tail = len < 256 ? len : 256;
+
+return NULL != memmem (p + len - tail, tail, "# Acquisition stop:", 19);
+}
+
+/********************************************************
+* pack_file: Compacts one data file into file.k2z,      *
+*            after verifying the round trip.            *
+* Input:    - name of data file                         *
+*           - 1: also pack unfinished files             *
+*           - 1: remove original when done              *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+static int pack_file (const char *name, int do_force, int do_remove)
+{
+char    zname[PATH_MAX], tmp[PATH_MAX];
+const char *in;
+const uint8_t *z;
+size_t  len, zlen;
+struct sink s;
+FILE    *out;
+int     ok;
+
+if (NULL == (in = map_file (name, &len)))
+    {
+    fprintf(stderr, "Could not open '%s' for reading.\n", name);
+    return 0;
+    }
+if (!do_force && !finished (in, len))
+    {
+    if (verbose)
+        fprintf(stderr, "%s: acquisition not finished, skipped.\n", name);
+    munmap ((void *)in, len ? len : 1);
+    return 1;
+    }
+
+snprintf (zname, sizeof(zname), "%s.k2z", name);
+snprintf (tmp, sizeof(tmp), "%s.k2z.%d", name, (int)getpid());
+if (NULL == (out = fopen (tmp, "wb")))
+    {
+    fprintf(stderr, "Could not open '%s' for writing.\n", tmp);
+    munmap ((void *)in, len ? len : 1);
+    return 0;
+    }
+setvbuf (out, NULL, _IOFBF, 1 << 16);
+ok = encode (in, len, out);
+zlen = ftell (out);
+if (fflush (out) || fsync (fileno (out)))
+    ok = 0;
+fclose (out);
+if (ok && zlen >= len)              /* nothing to gain */
+    {
+    if (verbose)
+        fprintf(stderr, "%s: %lu -> %lu bytes, kept as is.\n", name,
+                (unsigned long)len, (unsigned long)zlen);
+    unlink (tmp);
+    munmap ((void *)in, len ? len : 1);
+    return 1;
+    }
+
+/* --- round trip: decode the archive and compare with the original --- */
+
+if (ok && NULL != (z = (const uint8_t *)map_file (tmp, &zlen)))
+    {
+    memset (&s, 0, sizeof(s));
+    s.cmp = in;
+    s.cmplen = len;
+    s.ok = 1;
+    s.tmin = -HUGE_VAL;
+    s.tmax = HUGE_VAL;
+    ok = decode (z, zlen, &s, 0) && s.ok && s.pos == len;
+    munmap ((void *)z, zlen ? zlen : 1);
+    if (ok && verbose)
+        fprintf(stderr, "%s: %lu -> %lu bytes (%.1f%%), verified.\n", name,
+                (unsigned long)len, (unsigned long)zlen, len ? 100.0 * zlen / len : 0.0);
+    }
+else
+    ok = 0;
+munmap ((void *)in, len ? len : 1);
+
+if (!ok || rename (tmp, zname))
+    {
+    fprintf(stderr, "%s: compaction failed, original kept.\n", name);
+    unlink (tmp);
+    return 0;
+    }
+if (do_remove && unlink (name))
+    fprintf(stderr, "%s: could not remove: %s\n", name, strerror (errno));
+return 1;
+}
+
+/********************************************************
+* unpack_file: Converts an archive back to text, or     *
+*              shows its summary.                       *
+* Input:    - name of archive                           *
+*           - output file                               *
+*           - time range (minutes)                      *
+*           - 1: only show summary and index            *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+static int unpack_file (const char *name, FILE *out, double tmin, double tmax, int info)
+{
+const uint8_t *z;
+size_t  zlen;
+struct sink s;
+int     ok;
+
+if (NULL == (z = (const uint8_t *)map_file (name, &zlen)))
+    {
+    fprintf(stderr, "Could not open '%s' for reading.\n", name);
+    return 0;
+    }
+memset (&s, 0, sizeof(s));
+s.fp = out;
+s.tmin = tmin;
+s.tmax = tmax;
+setvbuf (out, NULL, _IOFBF, 1 << 16);
+if (!(ok = decode (z, zlen, &s, info)))
+    fprintf(stderr, "'%s' is not a valid archive or is damaged.\n", name);
+munmap ((void *)z, zlen ? zlen : 1);
+if (fflush (out))
+    ok = 0;
+return ok;
+}
+
+/********************************************************
+* run_parallel: Packs files in worker processes.        *
+* Input:    - file names and their number               *
+*           - maximum number of workers                 *
+*           - options for pack_file()                   *
+* Return:   1 if all OK, 0 if any failed                *
+********************************************************/
+static int run_parallel (char **names, int n, int jobs, int do_force, int do_remove)
+{
+int     i, running = 0, status, ok = 1;
+pid_t   pid;
+
+for (i = 0; i < n || running > 0; )
+    {
+    if (i < n && running < jobs)
+        {
+        if ((pid = fork ()) == 0)
+            _exit (pack_file (names[i], do_force, do_remove) ? 0 : 1);
+        if (pid < 0)                /* no more processes: do it here */
+            ok &= pack_file (names[i], do_force, do_remove);
+        else
+            running++;
+        i++;
+        continue;
+        }
+    if (wait (&status) < 0)
+        break;
+    running--;
+    if (!WIFEXITED (status) || WEXITSTATUS (status))
+        ok = 0;
+    }
+return ok;
+}
+
+/********************************************************
+* low_priority: Lowest CPU priority, idle I/O class,    *
+*               so that running acquisitions and plots  *
+*               are not disturbed.                      *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+static void low_priority (void)
+{
+setpriority (PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+syscall (SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif
+}
+
+/********************************************************
+* scan_dir: Packs all finished data files in a folder   *
+*           which have no archive yet.                  *
+* Input:    - folder                                    *
+*           - suffix of data files                      *
+*           - options for run_parallel()                *
+* Return:   1 if all OK, 0 if any failed                *
+********************************************************/
+static int scan_dir (const char *dir, const char *suffix, int jobs, int do_remove)
+{
+DIR     *d;
+struct dirent *e;
+struct stat st;
+char    **names = NULL, path[PATH_MAX], zpath[PATH_MAX + 4];
+size_t  ls = strlen (suffix), ln;
+int     n = 0, i, ok;
+
+if (NULL == (d = opendir (dir)))
+    {
+    fprintf(stderr, "Could not open folder '%s'.\n", dir);
+    return 0;
+    }
+while ((e = readdir (d)) != NULL)
+    {
+    ln = strlen (e->d_name);
+    if (ln <= ls || strcmp (e->d_name + ln - ls, suffix))
+        continue;
+    snprintf (path, sizeof(path), "%s/%s", dir, e->d_name);
+    snprintf (zpath, sizeof(zpath), "%s.k2z", path);
+    if (stat (path, &st) || !S_ISREG (st.st_mode) || !stat (zpath, &st))
+        continue;                   /* not a file, or done already */
+    if (NULL == (names = realloc (names, (n + 1) * sizeof(*names))))
+        break;
+    names[n++] = strdup (path);
+    }
+closedir (d);
+
+ok = run_parallel (names, n, jobs, 0, do_remove);
+for (i = 0; i < n; i++)
+    free (names[i]);
+free (names);
+return ok;
+}
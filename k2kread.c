@@ -0,0 +1,288 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K R E A D . C
+
+ Command line wrapper around the fast k2000 data file reader.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Without options, prints the header and some statistics of a data file.
+ With -c, writes the data as plain numeric columns (no unit suffixes,
+ NaN for OVERFLOW), ready for any other program. With -b, compares the
+ speed of the memory-mapped reader (k2kmap.c) with the line reader
+ (k2kfile.c) and with naive fscanf() parsing, and checks that all three
+ give the same numbers.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2kread.c k2kmap.c k2kfile.c -lm -o k2kread
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>     /* getopt() */
+#include "k2kfile.h"
+
+#define ERR_FILE  4         /* error code */
+#define CHUNK     4096      /* records converted per call */
+
+struct result
+{
+    double  sec;            /* best run time */
+    size_t  n;              /* records */
+    double  tsum, vsum;     /* checksums */
+};
+
+static double now (void);
+static void bench_fscanf (const char *name, struct result *r);
+static void bench_lines (const char *name, struct result *r);
+static void bench_map (const char *name, struct result *r);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kread [-h] [-c] [-b] datafile"
+"\n        -h       this help screen"
+"\n        -c       write numeric columns 'minutes value' to standard output"
+"\n        -b       benchmark against line-wise and fscanf() parsing\n\n";
+
+static double t[CHUNK], v[CHUNK];
+struct k2kmap m;
+struct result res[3];
+static char *names[] = {"fscanf", "k2k_next", "k2k_columns"};
+int     key, i, do_columns = 0, do_bench = 0;
+size_t  pos = 0, n, k, total = 0, nan = 0;
+double  vmin = HUGE_VAL, vmax = -HUGE_VAL, sum = 0.0, tlast = 0.0;
+
+while ((key = getopt(argc, argv, "hcb")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 'c':
+            do_columns = 1;
+            continue;
+        case 'b':
+            do_bench = 1;
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+if (argv[optind] == NULL)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify a data file.\n");
+    return 1;
+    }
+
+if (do_bench)
+    {
+    bench_fscanf (argv[optind], &res[0]);
+    bench_lines (argv[optind], &res[1]);
+    bench_map (argv[optind], &res[2]);
+    for (i = 0; i < 3; i++)
+        printf("%-12s %10lu records %8.3f s %10.1f Mrec/s %6.2fx   sum %.9g / %.9g\n",
+               names[i], (unsigned long)res[i].n, res[i].sec,
+               res[i].n / res[i].sec / 1e6, res[0].sec / res[i].sec,
+               res[i].tsum, res[i].vsum);
+    for (i = 1; i < 3; i++)
+        if (res[i].n != res[0].n || res[i].tsum != res[0].tsum || res[i].vsum != res[0].vsum)
+            {
+            fprintf(stderr, "Warning: %s and %s do not agree.\n", names[i], names[0]);
+            return 1;
+            }
+    return 0;
+    }
+
+if (!k2k_map (&m, argv[optind]))
+    {
+    fprintf(stderr, "Could not open '%s' for reading.\n", argv[optind]);
+    return ERR_FILE;
+    }
+
+while ((n = k2k_columns (&m, &pos, t, v, CHUNK)) > 0)
+    {
+    for (k = 0; k < n; k++)
+        {
+        if (do_columns)
+            {
+            if (isnan(v[k]))
+                printf("%.4f\tNaN\n", t[k]);
+            else
+                printf("%.4f\t%.9g\n", t[k], v[k]);
+            }
+        if (isnan(v[k]))
+            {
+            nan++;
+            continue;
+            }
+        if (v[k] < vmin)
+            vmin = v[k];
+        if (v[k] > vmax)
+            vmax = v[k];
+        sum += v[k];
+        }
+    total += n;
+    tlast = t[n-1];
+    }
+
+if (!do_columns)
+    {
+    printf("        File :  %s\n", m.info.name);
+    printf("     Version :  %s\n", m.info.version);
+    printf("  Instrument :  %s\n", m.info.instrument);
+    printf("     Comment :  %s\n", m.info.comment);
+    if (m.info.start)
+        printf("       Start :  %s", ctime(&m.info.start));
+    printf("        Unit :  %s\n", m.unit);
+    printf("     Samples :  %lu (%lu OVERFLOW)\n", (unsigned long)total, (unsigned long)nan);
+    printf("    Duration :  %.4f min\n", tlast);
+    if (total > nan)
+        printf("Min/Mean/Max :  %.9g / %.9g / %.9g\n", vmin, sum / (total - nan), vmax);
+    }
+
+k2k_unmap (&m);
+return 0;
+}
+
+
+/********************************************************
+* now: Returns a monotonic time stamp.                  *
+* Input:    Nothing.                                    *
+* Return:   time in seconds                             *
+********************************************************/
+static double now (void)
+{
+struct timespec ts;
+
+clock_gettime (CLOCK_MONOTONIC, &ts);
+return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+#define RUNS 3          /* benchmark: best of ... */
+
+/* --- the "naive" way most scripts do it --- */
+static void bench_fscanf (const char *name, struct result *r)
+{
+FILE    *fp;
+char    buf[K2K_MAXLEN+1];
+double  t0, tt, vv;
+int     run;
+
+r->sec = HUGE_VAL;
+for (run = 0; run < RUNS; run++)
+    {
+    if (NULL == (fp = fopen (name, "rt")))
+        return;
+    r->n = 0;
+    r->tsum = r->vsum = 0.0;
+    t0 = now();
+    while (!feof (fp))
+        {
+        if (2 != fscanf (fp, "%lf %255s", &tt, buf))
+            {
+            if (fscanf (fp, "%*[^\n]") == EOF)    /* skip '#' line */
+                break;
+            fgetc (fp);
+            continue;
+            }
+        vv = k2k_reading (buf, NULL);
+        r->n++;
+        r->tsum += tt;
+        if (!isnan(vv))
+            r->vsum += vv;
+        }
+    t0 = now() - t0;
+    if (t0 < r->sec)
+        r->sec = t0;
+    fclose (fp);
+    }
+}
+
+/* --- k2kfile.c: fgets() and strtod() --- */
+static void bench_lines (const char *name, struct result *r)
+{
+struct k2kfile f;
+struct k2krec rec;
+double  t0;
+int     run;
+
+r->sec = HUGE_VAL;
+for (run = 0; run < RUNS; run++)
+    {
+    if (!k2k_open (&f, name))
+        return;
+    r->n = 0;
+    r->tsum = r->vsum = 0.0;
+    t0 = now();
+    while (k2k_next (&f, &rec))
+        {
+        r->n++;
+        r->tsum += rec.t;
+        if (!isnan(rec.value))
+            r->vsum += rec.value;
+        }
+    t0 = now() - t0;
+    if (t0 < r->sec)
+        r->sec = t0;
+    k2k_close (&f);
+    }
+}
+
+/* --- k2kmap.c: mmap() and k2k_number() --- */
+static void bench_map (const char *name, struct result *r)
+{
+static double t[CHUNK], v[CHUNK];
+struct k2kmap m;
+size_t  pos, n, k;
+double  t0;
+int     run;
+
+r->sec = HUGE_VAL;
+for (run = 0; run < RUNS; run++)
+    {
+    t0 = now();
+    if (!k2k_map (&m, name))
+        return;
+    r->n = 0;
+    r->tsum = r->vsum = 0.0;
+    pos = 0;
+    while ((n = k2k_columns (&m, &pos, t, v, CHUNK)) > 0)
+        {
+        for (k = 0; k < n; k++)
+            {
+            r->tsum += t[k];
+            if (!isnan(v[k]))
+                r->vsum += v[k];
+            }
+        r->n += n;
+        }
+    k2k_unmap (&m);
+    t0 = now() - t0;
+    if (t0 < r->sec)
+        r->sec = t0;
+    }
+}
@@ -0,0 +1,299 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K R E P L A Y . C
+
+ Plays back a recorded GPIB session instead of talking to the bus.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ The session is a trace written by 'k2000 -X' (k2ktrace.c), which holds
+ every command, every response, status and error code, and the time
+ each transaction took. bus_replay() loads it and makes k2kbus.c use
+ it as transport: each write is compared with the next recorded write,
+ each read returns the recorded response, including errors and
+ timeouts. Unless 'fast' is set, each transaction takes as long as it
+ did on the real bus.
+
+ As soon as k2000 sends something else than what was recorded (the
+ recording is over, or k2000 was started with other options), the
+ session has ended: bus_eof is set, and from then on writes succeed
+ and reads fail, so k2000 can stop in an orderly way.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "k2kbus.h"
+#include "k2ktrace.h"
+
+static char     *trace;         /* whole file */
+static size_t   size, pos;      /* ... and where we are */
+static int      fast;
+
+static int  replay_dev (int board, int pad, int sad, int tmo, int eot, int eos);
+static int  replay_write (int ud, const char *buf, long len);
+static int  replay_read (int ud, char *buf, long len);
+static int  replay_clear (int ud);
+static int  replay_close (int ud);
+static int  replay_tmo (int ud, int tmo);
+static int  replay_ifc (int board);
+static int  replay_spoll (int ud, char *stb);
+static int  replay_srq (int board);
+static int  replay_find (int board, int *pads, int max);
+
+static const struct bus_ops replay_ops =
+    {"replay", replay_dev, replay_write, replay_read, replay_clear, replay_close,
+     replay_tmo, replay_ifc, replay_spoll, replay_srq, replay_find};
+
+
+/********************************************************
+* bus_replay: Loads a recorded session and selects it   *
+*             as transport.                             *
+* Input:    - trace file name                           *
+*           - 1 to play as fast as possible             *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int bus_replay (const char *name, int f)
+{
+struct trace_head h;
+FILE    *fp;
+long    len;
+
+if (NULL == (fp = fopen (name, "rb")))
+    {
+    fprintf(stderr, "Could not open '%s' for reading.\n", name);
+    return 0;
+    }
+fseek (fp, 0L, SEEK_END);
+len = ftell (fp);
+rewind (fp);
+if (len < (long)sizeof(h) || NULL == (trace = malloc (len)) ||
+    1 != fread (trace, len, 1, fp))
+    {
+    fprintf(stderr, "Could not read '%s'.\n", name);
+    fclose (fp);
+    return 0;
+    }
+fclose (fp);
+
+memcpy (&h, trace, sizeof(h));
+if (memcmp (h.magic, TRACE_MAGIC, 4) || h.endian != 0x1234 || h.version != TRACE_VERSION)
+    {
+    fprintf(stderr, "'%s' is not a k2000 trace of this machine type.\n", name);
+    return 0;
+    }
+if (!(h.flags & TRACE_DATA))
+    {
+    fprintf(stderr, "'%s' holds no responses and cannot be played back.\n", name);
+    return 0;
+    }
+
+size = len;
+pos = sizeof(h);
+fast = f;
+bus_eof = 0;
+bus_use (&replay_ops);
+return 1;
+}
+
+
+/* returns the next recorded transaction, or NULL at the end */
+static const struct trace_rec *next (const char **data)
+{
+static struct trace_rec r;
+size_t  n;
+
+while (pos + sizeof(r) <= size)
+    {
+    memcpy (&r, trace + pos, sizeof(r));
+    n = sizeof(r) + ((r.nbytes + 7) & ~7UL);
+    if (pos + n > size)
+        break;
+    *data = trace + pos + sizeof(r);
+    pos += n;
+    if (r.op == TR_DEV || r.op == TR_WRITE || r.op == TR_READ || r.op == TR_CLEAR ||
+        r.op == TR_SPOLL)
+        return &r;
+    }
+return NULL;                    /* lost records and others are skipped */
+}
+
+/* takes as long as the recorded transaction */
+static void pace (const struct trace_rec *r)
+{
+struct timespec ts;
+unsigned long long ns = r->end - r->start;
+
+if (fast || !ns)
+    return;
+ts.tv_sec = ns / 1000000000ULL;
+ts.tv_nsec = ns % 1000000000ULL;
+nanosleep (&ts, NULL);
+}
+
+/* the session is over; say why, once */
+static void ended (const char *sent, const struct trace_rec *r, const char *data)
+{
+if (bus_eof)
+    return;
+bus_eof = 1;
+if (r && r->op == TR_WRITE)
+    fprintf(stderr, "\nReplay: sent '%.*s', recorded '%.*s' - session ends here.\n",
+            (int)strcspn (sent, "\r\n"), sent, (int)strcspn (data, "\r\n"), data);
+}
+
+
+static int replay_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+const struct trace_rec *r;
+const char *data;
+
+bus_cnt = bus_err = 0;
+if (NULL == (r = next (&data)) || r->op != TR_DEV)
+    {
+    ended (NULL, NULL, NULL);
+    bus_err = ENOL;
+    return -1;
+    }
+pace (r);
+if (r->err >= 0)
+    {
+    bus_err = r->err;
+    return -1;
+    }
+return r->dev;
+}
+
+static int replay_write (int ud, const char *buf, long len)
+{
+const struct trace_rec *r = NULL;
+const char *data = NULL;
+
+bus_cnt = len;
+bus_err = 0;
+if (bus_eof)
+    return CMPL;
+if (NULL == (r = next (&data)) || r->op != TR_WRITE ||
+    r->nbytes != (len < TRACE_MAXDATA ? len : TRACE_MAXDATA) || memcmp (data, buf, r->nbytes))
+    {
+    ended (buf, r, data);
+    return CMPL;
+    }
+pace (r);
+bus_cnt = r->count;
+if (r->err >= 0)
+    bus_err = r->err;
+return r->sta;
+}
+
+static int replay_read (int ud, char *buf, long len)
+{
+const struct trace_rec *r;
+const char *data;
+
+bus_cnt = 0;
+bus_err = EABO;
+if (bus_eof)
+    return ERR | TIMO;
+if (NULL == (r = next (&data)) || r->op != TR_READ)
+    {
+    ended (NULL, NULL, NULL);
+    return ERR | TIMO;
+    }
+pace (r);
+bus_cnt = (r->nbytes < len) ? r->nbytes : len;
+memcpy (buf, data, bus_cnt);
+bus_err = (r->err >= 0) ? r->err : 0;
+return r->sta;
+}
+
+static int replay_clear (int ud)
+{
+const struct trace_rec *r;
+const char *data;
+
+bus_cnt = bus_err = 0;
+if (bus_eof)
+    return CMPL;
+if (NULL == (r = next (&data)) || r->op != TR_CLEAR)
+    {
+    ended (NULL, NULL, NULL);
+    return CMPL;
+    }
+pace (r);
+if (r->err >= 0)
+    bus_err = r->err;
+return r->sta;
+}
+
+static int replay_close (int ud)
+{
+bus_cnt = bus_err = 0;
+return CMPL;
+}
+
+static int replay_tmo (int ud, int tmo)
+{
+bus_cnt = bus_err = 0;                  /* the recording has the outcome */
+return CMPL;
+}
+
+static int replay_ifc (int board)
+{
+return CMPL;                            /* never hangs */
+}
+
+static int replay_spoll (int ud, char *stb)
+{
+const struct trace_rec *r;
+const char *data;
+
+*stb = 0;
+bus_cnt = bus_err = 0;
+if (bus_eof)
+    return CMPL;
+if (NULL == (r = next (&data)) || r->op != TR_SPOLL)
+    {
+    ended (NULL, NULL, NULL);
+    return CMPL;
+    }
+pace (r);
+*stb = (char)r->arg;
+if (r->err >= 0)
+    bus_err = r->err;
+return r->sta;
+}
+
+/* SRQ was seen if a serial poll comes next in the recording */
+static int replay_srq (int board)
+{
+const struct trace_rec *r;
+const char *data;
+size_t  here = pos;
+int     srq;
+
+r = next (&data);
+srq = (r && r->op == TR_SPOLL);
+pos = here;
+return srq;
+}
+
+static int replay_find (int board, int *pads, int max)
+{
+return -1;                              /* not recorded */
+}
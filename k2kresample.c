@@ -0,0 +1,269 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K R E S A M P L E . C
+
+ Resamples k2000 data files onto a common, uniform time grid.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ The grid starts at the earliest acquisition start of all files and
+ has a fixed step. For every grid point g, each file gives
+
+    hold    the last reading at or before g,
+    linear  the linear interpolation between the readings around g,
+    mean    the mean of all readings in the cell [g, g+step).
+
+ Outside the time span of a file, and for empty cells, "NaN" is written.
+ OVERFLOW readings are NaN, and are left out of the mean.
+
+ All files are read in a single pass, each source keeps only the two
+ readings around the current grid point and a running sum, so memory
+ use does not depend on the size of the files.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2kresample.c k2kfile.c -lm -o k2kresample
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>     /* getopt() */
+#include "k2kfile.h"
+
+#define ERR_FILE  4         /* error code */
+
+enum { HOLD, LINEAR, MEAN };
+
+struct source
+{
+    struct k2kfile  f;
+    struct k2krec   r;
+    double  tprev, vprev;       /* last reading at or before grid point */
+    double  tnext, vnext;       /* first reading after it (lookahead) */
+    int     have_prev, have_next;
+};
+
+static struct source *src;
+
+static void advance (struct source *s);
+static double sample (struct source *s, int method, double g, double step);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2kresample [-h] [-s step] [-m method] [-e] [-o outfile] file1 [file2 ...]"
+"\n        -h         this help screen"
+"\n        -s step    grid step in seconds (default is 1)"
+"\n        -m method  hold, linear or mean (default is hold)"
+"\n        -e         time as seconds since the Epoch (default: minutes since first start)"
+"\n        -o file    write to 'file' (default: standard output)\n\n";
+
+static char *methods[] = {"hold", "linear", "mean"};
+FILE    *out = stdout;
+int     key, i, n, method = HOLD, do_epoch = 0, active;
+double  step = 1.0, t0, g, v;
+unsigned long k;
+time_t  tstart;
+
+while ((key = getopt(argc, argv, "hs:m:eo:")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 's':
+            step = atof (optarg);
+            if (step <= 0.0)
+                {
+                fprintf(stderr, "Error: step must be positive.\n");
+                return 1;
+                }
+            continue;
+        case 'm':
+            for (method = 0; method < 3; method++)
+                if (!strcmp (optarg, methods[method]))
+                    break;
+            if (method == 3)
+                {
+                fprintf(stderr, "Error: method must be hold, linear or mean.\n");
+                return 1;
+                }
+            continue;
+        case 'e':
+            do_epoch = 1;
+            continue;
+        case 'o':
+            if (NULL == (out = fopen(optarg, "wt")))
+                {
+                fprintf(stderr, "Could not open '%s' for writing.\n", optarg);
+                return ERR_FILE;
+                }
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+n = argc - optind;
+if (n < 1)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify at least one data file.\n");
+    return 1;
+    }
+
+if (NULL == (src = calloc (n, sizeof(*src))))
+    {
+    fprintf (stderr, "Out of memory.\n");
+    return 1;
+    }
+
+tstart = 0;
+for (i = 0; i < n; i++)
+    {
+    if (!k2k_open (&src[i].f, argv[optind+i]))
+        {
+        fprintf(stderr, "Could not open '%s' for reading.\n", argv[optind+i]);
+        return ERR_FILE;
+        }
+    if (!src[i].f.start)
+        {
+        fprintf(stderr, "'%s': no acquisition start time in header.\n", src[i].f.name);
+        return ERR_FILE;
+        }
+    if (!tstart || src[i].f.start < tstart)
+        tstart = src[i].f.start;
+    advance (&src[i]);          /* load lookahead */
+    }
+t0 = (double)tstart;
+
+setvbuf (out, NULL, _IOFBF, 1 << 16);
+
+fprintf(out, "# k2kresample " VERSION "\n");
+for (i = 0; i < n; i++)
+    fprintf(out, "# Source %d: %s (%s), start %s", i+1, src[i].f.name,
+            src[i].f.instrument, ctime(&src[i].f.start));
+fprintf(out, "# Grid: %g s, %s\n", step, methods[method]);
+fprintf(out, "# Acquisition start: %s", ctime(&tstart));
+fprintf(out, "# %s", do_epoch ? "s" : "min");
+for (i = 0; i < n; i++)
+    fprintf(out, "\t%d", i+1);
+fprintf(out, "\n");
+
+/* --- walk the grid until all files are exhausted --- */
+
+for (k = 0; ; k++)
+    {
+    g = t0 + (double)k * step;      /* no accumulated rounding error */
+    active = 0;
+    for (i = 0; i < n; i++)
+        if (src[i].have_next || (src[i].have_prev && src[i].tprev >= g))
+            active = 1;
+    if (!active)
+        break;
+
+    if (do_epoch)
+        fprintf(out, "%.3f", g);
+    else
+        fprintf(out, "%.4f", (g - t0) / 60.0);
+    for (i = 0; i < n; i++)
+        {
+        v = sample (&src[i], method, g, step);
+        if (isnan(v))
+            fputs ("\tNaN", out);
+        else
+            fprintf(out, "\t%.9g", v);
+        }
+    fputc ('\n', out);
+    }
+
+for (i = 0; i < n; i++)
+    k2k_close (&src[i].f);
+if (out != stdout)
+    fclose (out);
+free (src);
+return 0;
+}
+
+
+/********************************************************
+* advance: Moves the lookahead reading into 'prev' and  *
+*          reads the next one.                          *
+* Input:    - pointer to source                         *
+* Return:   Nothing.                                    *
+********************************************************/
+static void advance (struct source *s)
+{
+if (s->have_next)
+    {
+    s->tprev = s->tnext;
+    s->vprev = s->vnext;
+    s->have_prev = 1;
+    }
+s->have_next = k2k_next (&s->f, &s->r);
+if (s->have_next)
+    {
+    s->tnext = (double)s->f.start + s->r.t * 60.0;
+    s->vnext = s->r.value;
+    }
+}
+
+
+/********************************************************
+* sample: Computes the value of a source at a grid      *
+*         point, consuming its readings up to there.    *
+* Input:    - pointer to source                         *
+*           - HOLD, LINEAR or MEAN                      *
+*           - grid time, s since the Epoch              *
+*           - grid step, s                              *
+* Return:   value, NAN if none                          *
+********************************************************/
+static double sample (struct source *s, int method, double g, double step)
+{
+double  sum = 0.0;
+long    cnt = 0;
+
+if (method == MEAN)
+    {
+    while (s->have_next && s->tnext < g + step)
+        {
+        if (s->tnext >= g && !isnan(s->vnext))
+            {
+            sum += s->vnext;
+            cnt++;
+            }
+        advance (s);
+        }
+    return cnt ? sum / (double)cnt : NAN;
+    }
+
+while (s->have_next && s->tnext <= g)
+    advance (s);
+
+if (!s->have_prev)                  /* before first reading */
+    return NAN;
+if (!s->have_next)                  /* after last reading */
+    return (s->tprev == g) ? s->vprev : NAN;
+if (method == HOLD || s->tprev == g)
+    return s->vprev;
+return s->vprev + (s->vnext - s->vprev) * (g - s->tprev) / (s->tnext - s->tprev);
+}
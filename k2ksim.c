@@ -0,0 +1,274 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K S I M . C
+
+ A simulated Keithley 2000, for benchmarks and tests without hardware.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ bus_simulate() makes k2kbus.c talk to this instead of the bus. The
+ "instrument" understands just what k2000 sends: it answers "*idn?",
+ "*opc?", ":read?", ":syst:err?" and what k2000 asks to check its
+ setup, remembers the function set with ":func" (an unknown one is an
+ error) and whether units are to be sent, saves and recalls these with
+ "*sav" and "*rcl", keeps an error queue and requests service as set
+ with "*sre", takes as many readings per ":read?" as set with
+ ":samp:coun", and ignores everything else. Readings are a slow random
+ walk, formatted exactly like those of a real K2000, and now and then
+ an overflow.
+
+ Each reading takes 'latency' microseconds, so the cost of the program
+ itself can be measured with 0, and a given instrument speed can be
+ mimicked otherwise. Reading when nothing was asked for gives a
+ timeout at once, without waiting for it; a reading that takes longer
+ than the I/O timeout gives a timeout after that time. The latency is
+ spent on the clock of k2kclock.c, so it costs no real time in a soak
+ test.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "k2kbus.h"
+#include "k2kclock.h"
+
+#define IDN "KEITHLEY INSTRUMENTS INC.,MODEL 2000,0000000,A20 /A02 (simulated)"
+
+static long     latency;            /* us per reading */
+static char     reply[1024*24];     /* waiting to be read */
+static int      fn = 0, units = 0;   /* function, and whether units are sent */
+static int      samples = 1;        /* readings per trigger */
+static int      nread = 1;          /* ... in the reply waiting */
+static struct { int fn, units; } slot[5];       /* *sav, *rcl */
+static double   value = 1.0e-3;
+static unsigned long seed = 12345;
+
+#define EAV     0x04                /* status byte: error available */
+#define RQS     0x40                /* ... requesting service */
+#define NERR    10                  /* error queue, as the K2000 has */
+
+static const char *errq[NERR];
+static int      nerr = 0, sre = 0, rqs = 0;
+
+static int  sim_dev (int board, int pad, int sad, int tmo, int eot, int eos);
+static int  sim_write (int ud, const char *buf, long len);
+static int  sim_read (int ud, char *buf, long len);
+static int  sim_clear (int ud);
+static int  sim_close (int ud);
+static int  sim_tmo (int ud, int tmo);
+static int  sim_ifc (int board);
+static int  sim_spoll (int ud, char *stb);
+static int  sim_srq (int board);
+static int  sim_find (int board, int *pads, int max);
+
+static const struct bus_ops sim_ops =
+    {"simulator", sim_dev, sim_write, sim_read, sim_clear, sim_close,
+     sim_tmo, sim_ifc, sim_spoll, sim_srq, sim_find};
+
+
+/********************************************************
+* bus_simulate: Selects the simulated instrument as     *
+*               transport.                              *
+* Input:    - time per reading in microseconds          *
+* Return:   1                                           *
+********************************************************/
+int bus_simulate (long us)
+{
+latency = us;
+reply[0] = 0;
+bus_use (&sim_ops);
+return 1;
+}
+
+
+static const char *func[][3] =       /* as set, unit, as queried */
+    {{"volt:dc", "VDC", "VOLT:DC"}, {"curr:dc", "ADC", "CURR:DC"}, {"res", "OHM", "RES"},
+     {"temp", "C", "TEMP"}, {"cont", "OHM", "CONT"}, {"diod", "VDC", "DIOD"}};
+
+
+/* next readings: random walk, deterministic from run to run */
+static void reading (void)
+{
+int     i, k = 0;
+
+for (i = 0; i < samples; i++)
+    {
+    seed = seed * 1103515245UL + 12345UL;
+    value += ((long)((seed >> 16) & 0x7fff) - 16384) * 1e-9;
+    if (((seed >> 8) & 0xfff) == 0)
+        k += snprintf (reply + k, sizeof(reply) - k, "%s+9.9E37", i ? "," : "");
+    else
+        k += snprintf (reply + k, sizeof(reply) - k, "%s%+.8E%s", i ? "," : "",
+                       value, units ? func[fn][1] : "");
+    }
+snprintf (reply + k, sizeof(reply) - k, "\n");
+}
+
+
+/* puts an error into the queue, and requests service if so told */
+static void error (const char *text)
+{
+if (nerr < NERR)
+    errq[nerr++] = text;
+else
+    errq[NERR-1] = "-350,\"Queue overflow\"";
+if (sre & EAV)
+    rqs = 1;
+}
+
+
+static int sim_dev (int board, int pad, int sad, int tmo, int eot, int eos)
+{
+bus_cnt = bus_err = 0;
+return 0;
+}
+
+static int sim_write (int ud, const char *buf, long len)
+{
+const char *p;
+int     i;
+
+if (strstr (buf, "*rst"))
+    {
+    fn = units = 0;
+    samples = 1;
+    }
+if (NULL != (p = strstr (buf, ":samp:coun ")) && (i = atoi (p + 11)) >= 1 && i <= 1024)
+    samples = i;
+if (NULL != (p = strstr (buf, "*sav ")) && (i = atoi (p + 5)) >= 0 && i < 5)
+    {
+    slot[i].fn = fn;
+    slot[i].units = units;
+    }
+if (NULL != (p = strstr (buf, "*rcl ")) && (i = atoi (p + 5)) >= 0 && i < 5)
+    {
+    fn = slot[i].fn;
+    units = slot[i].units;
+    }
+if (strstr (buf, ":form:elem read,unit"))
+    units = 1;
+if (strstr (buf, "*cls"))
+    nerr = rqs = 0;
+if (NULL != (p = strstr (buf, "*sre ")))
+    sre = atoi (p + 5);
+if (NULL != (p = strstr (buf, ":func '")))
+    {
+    for (i = 0; i < 6; i++)
+        if (!strncmp (p + 7, func[i][0], strlen (func[i][0])))
+            break;
+    if (i < 6)
+        fn = i;
+    else
+        error ("-224,\"Illegal parameter value\"");
+    }
+
+nread = 1;
+if (strstr (buf, ":syst:err?"))
+    {
+    snprintf (reply, sizeof(reply), "%s\n", nerr ? errq[0] : "0,\"No error\"");
+    if (nerr)
+        memmove (errq, errq + 1, --nerr * sizeof(errq[0]));
+    }
+else if (strstr (buf, ":func?;:form:elem?"))
+    snprintf (reply, sizeof(reply), "\"%s\";%s\n", func[fn][2], units ? "READ,UNIT" : "READ");
+else if (strstr (buf, "*idn?"))
+    snprintf (reply, sizeof(reply), "%s\n", IDN);
+else if (strstr (buf, "*opc?"))
+    strcpy (reply, "1\n");
+else if (strstr (buf, ":read?"))
+    {
+    reading ();
+    nread = samples;
+    }
+
+bus_cnt = len;
+bus_err = 0;
+return CMPL;
+}
+
+static int sim_read (int ud, char *buf, long len)
+{
+if (!reply[0])
+    {
+    bus_cnt = 0;
+    bus_err = EABO;
+    return ERR | TIMO;
+    }
+if (bus_timeout_ns () && latency * 1000ULL * nread > bus_timeout_ns ())
+    {
+    clock_sleep (bus_timeout_ns ());    /* too slow for the timeout */
+    reply[0] = 0;
+    bus_cnt = 0;
+    bus_err = EABO;
+    return ERR | TIMO;
+    }
+if (latency > 0)
+    clock_sleep (latency * 1000ULL * nread);
+bus_cnt = strlen (reply);
+if (bus_cnt > len)
+    bus_cnt = len;
+memcpy (buf, reply, bus_cnt);
+reply[0] = 0;
+bus_err = 0;
+return CMPL | END;
+}
+
+static int sim_clear (int ud)
+{
+reply[0] = 0;
+bus_cnt = bus_err = 0;
+return CMPL;
+}
+
+static int sim_close (int ud)
+{
+bus_cnt = bus_err = 0;
+return CMPL;
+}
+
+static int sim_tmo (int ud, int tmo)
+{
+bus_cnt = bus_err = 0;                  /* see bus_timeout_ns() */
+return CMPL;
+}
+
+static int sim_ifc (int board)
+{
+return CMPL;                            /* never hangs */
+}
+
+static int sim_spoll (int ud, char *stb)
+{
+*stb = (nerr ? EAV : 0) | (rqs ? RQS : 0);
+rqs = 0;
+bus_cnt = bus_err = 0;
+return CMPL;
+}
+
+static int sim_srq (int board)
+{
+return rqs;
+}
+
+static int sim_find (int board, int *pads, int max)
+{
+if (board != 0)
+    return -1;
+if (max > 0)
+    pads[0] = 16;                       /* the default address */
+return max > 0;
+}
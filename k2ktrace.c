@@ -0,0 +1,220 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K T R A C E . C
+
+ Binary trace of GPIB transactions.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ trace_add() only copies the record into a ring buffer in memory; a
+ separate thread writes the ring to the trace file. So the acquisition
+ loop never waits for the disk. If the writer cannot keep up and the
+ ring is full, records are dropped and counted, and a TR_LOST record
+ with the number of dropped records is written as soon as there is
+ room again.
+
+ One thread adds records (the one doing the bus I/O), one thread writes
+ them: the ring needs no lock, just two atomic counters.
+
+ Use k2ktrdump to look at a trace.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include "k2ktrace.h"
+#include "k2khist.h"
+
+#define RINGSIZE    (1 << 20)       /* bytes, power of 2 */
+
+int         trace_active = 0;
+uint32_t    trace_flags = 0;
+
+static char         ring[RINGSIZE];
+static atomic_ullong head, tail;    /* bytes ever written / read */
+static atomic_int   stop;
+static unsigned long lost;          /* records dropped, not yet reported */
+static FILE         *fp;
+static pthread_t    writer;
+
+static void *write_ring (void *arg);
+static int  drain (void);
+
+
+/********************************************************
+* trace_start: Opens the trace file and starts the      *
+*              writer thread.                           *
+* Input:    - file name                                 *
+*           - TRACE_DATA to record responses as well    *
+* Return:   1 if OK, 0 if error                         *
+********************************************************/
+int trace_start (const char *name, uint32_t flags)
+{
+struct trace_head h;
+struct timeval tv;
+
+if (NULL == (fp = fopen (name, "wb")))
+    {
+    fprintf(stderr, "Could not open '%s' for writing.\n", name);
+    return 0;
+    }
+memset (&h, 0, sizeof(h));
+memcpy (h.magic, TRACE_MAGIC, 4);
+h.version = TRACE_VERSION;
+h.endian = 0x1234;
+h.flags = trace_flags = flags;
+h.t0 = nanotime();
+gettimeofday (&tv, NULL);
+h.wall = tv.tv_sec + tv.tv_usec / 1e6;
+fwrite (&h, sizeof(h), 1, fp);
+
+atomic_store (&head, 0);
+atomic_store (&tail, 0);
+atomic_store (&stop, 0);
+lost = 0;
+if (pthread_create (&writer, NULL, write_ring, NULL))
+    {
+    fclose (fp);
+    return 0;
+    }
+trace_active = 1;
+return 1;
+}
+
+
+/* copies into the ring, wrapping around at the end */
+static void put (unsigned long long pos, const void *p, size_t n)
+{
+size_t  off = pos & (RINGSIZE - 1), first = RINGSIZE - off;
+
+if (first > n)
+    first = n;
+memcpy (ring + off, p, first);
+memcpy (ring, (const char *)p + first, n - first);
+}
+
+/********************************************************
+* trace_add: Adds a record to the trace.                *
+* Input:    - operation (TR_...)                        *
+*           - unit descriptor                           *
+*           - start and end time, from nanotime()       *
+*           - status word, iberr (-1 if none), ibcnt    *
+*           - op specific argument                      *
+*           - data (command or response) and length     *
+* Return:   Nothing.                                    *
+********************************************************/
+void trace_add (int op, int dev, unsigned long long start, unsigned long long end,
+                int sta, int err, long count, uint32_t arg, const void *data, long len)
+{
+struct trace_rec r;
+unsigned long long h = atomic_load_explicit (&head, memory_order_relaxed);
+unsigned long long t = atomic_load_explicit (&tail, memory_order_acquire);
+size_t  size;
+static const char zero[8];
+
+if (len > TRACE_MAXDATA)
+    len = TRACE_MAXDATA;
+if (len < 0 || !data)
+    len = 0;
+size = sizeof(r) + ((len + 7) & ~7L);
+
+if (lost && RINGSIZE - (h - t) >= 2 * sizeof(r) + size)
+    {
+    memset (&r, 0, sizeof(r));      /* tell the reader about the gap */
+    r.start = r.end = start;
+    r.op = TR_LOST;
+    r.err = -1;
+    r.arg = (uint32_t)lost;
+    put (h, &r, sizeof(r));
+    h += sizeof(r);
+    lost = 0;
+    }
+if (RINGSIZE - (h - t) < size)
+    {
+    lost++;
+    atomic_store_explicit (&head, h, memory_order_release);
+    return;
+    }
+
+r.start = start;
+r.end = end;
+r.count = (uint32_t)count;
+r.sta = (uint16_t)sta;
+r.err = (int16_t)err;
+r.op = (uint8_t)op;
+r.dev = (uint8_t)dev;
+r.nbytes = (uint16_t)len;
+r.arg = arg;
+put (h, &r, sizeof(r));
+put (h + sizeof(r), data, len);
+put (h + sizeof(r) + len, zero, size - sizeof(r) - len);
+atomic_store_explicit (&head, h + size, memory_order_release);
+}
+
+
+/********************************************************
+* trace_stop: Writes what is left, closes the file.     *
+* Input:    Nothing.                                    *
+* Return:   Nothing.                                    *
+********************************************************/
+void trace_stop (void)
+{
+if (!trace_active)
+    return;
+trace_active = 0;
+atomic_store (&stop, 1);
+pthread_join (writer, NULL);
+drain ();
+fclose (fp);
+}
+
+
+/* writes everything between tail and head; returns bytes written */
+static int drain (void)
+{
+unsigned long long h = atomic_load_explicit (&head, memory_order_acquire);
+unsigned long long t = atomic_load_explicit (&tail, memory_order_relaxed);
+size_t  off = t & (RINGSIZE - 1), n = h - t, first = RINGSIZE - off;
+
+if (!n)
+    return 0;
+if (first > n)
+    first = n;
+fwrite (ring + off, 1, first, fp);
+fwrite (ring, 1, n - first, fp);
+atomic_store_explicit (&tail, h, memory_order_release);
+return (int)n;
+}
+
+/* writer thread: empty the ring every few ms */
+static void *write_ring (void *arg)
+{
+struct timespec ts = {0, 20000000};
+
+(void)arg;
+while (!atomic_load (&stop))
+    {
+    if (!drain ())
+        fflush (fp);
+    nanosleep (&ts, NULL);
+    }
+return NULL;
+}
@@ -0,0 +1,66 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K T R A C E . H
+
+ Binary trace of GPIB transactions.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details.
+
+*/
+
+#ifndef K2KTRACE_H
+#define K2KTRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC     "K2TR"
+#define TRACE_VERSION   1
+
+/* --- file header --- */
+
+struct trace_head
+{
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    endian;         /* 0x1234 as written */
+    uint32_t    flags;          /* TRACE_DATA */
+    uint32_t    reserved;
+    uint64_t    t0;             /* nanotime() at start */
+    double      wall;           /* same moment, s since the Epoch */
+};
+
+#define TRACE_DATA      1       /* responses are recorded, too */
+
+/* --- one transaction, followed by 'nbytes' of data, padded to 8 --- */
+
+struct trace_rec
+{
+    uint64_t    start, end;     /* nanotime() */
+    uint32_t    count;          /* bytes transferred (ibcnt) */
+    uint16_t    sta;            /* status word (ibsta) */
+    int16_t     err;            /* iberr, -1 if no error */
+    uint8_t     op;             /* TR_... */
+    uint8_t     dev;            /* unit descriptor */
+    uint16_t    nbytes;         /* data following */
+    uint32_t    arg;            /* op specific, e.g. address or timeout */
+};
+
+enum { TR_DEV = 1, TR_WRITE, TR_READ, TR_CLEAR, TR_TMO, TR_SPOLL, TR_IFC, TR_LOST };
+
+#define TRACE_MAXDATA   4096    /* longer data is cut */
+
+extern int  trace_active;       /* test this before calling trace_add() */
+extern uint32_t trace_flags;    /* as given to trace_start() */
+
+int     trace_start (const char *name, uint32_t flags);
+void    trace_add (int op, int dev, unsigned long long start, unsigned long long end,
+                   int sta, int err, long count, uint32_t arg, const void *data, long len);
+void    trace_stop (void);
+
+#endif
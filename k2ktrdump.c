@@ -0,0 +1,255 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K T R D U M P . C
+
+ Decodes a GPIB trace written by 'k2000 -X'.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ Prints the transactions as a timeline (time since start of the trace,
+ duration, status, data), followed by latency statistics per command.
+ A read is counted for the command written last to the same device, so
+ the statistics of ":read?" show how long the instrument needs from
+ the trigger to the end of the response.
+
+ This should compile with any C compiler, something like:
+
+ gcc -Wall -O2 k2ktrdump.c k2khist.c -o k2ktrdump
+
+*/
+
+#define VERSION "V20261018"	/* String! */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>     /* getopt() */
+#include "k2ktrace.h"
+#include "k2khist.h"
+
+#define ERR_FILE  4         /* error code */
+#define MAXCMD    64        /* different commands in the statistics */
+#define CMDLEN    40        /* ... compared up to this length */
+#define MAXDEV    256
+
+static struct
+{
+    char        text[CMDLEN+1];
+    struct hist write;      /* duration of the write */
+    struct hist reply;      /* start of write to end of read */
+    unsigned long errors;
+} cmd[MAXCMD];
+
+static int  ncmd = 0;
+static const char *opname[] =
+    {"?", "dev", "write", "read", "clear", "tmo", "spoll", "ifc", "LOST"};
+
+static int  find_cmd (const char *data, int len);
+static void print_data (const char *data, int len);
+
+
+int main (int argc, char *argv[])
+{
+static char *msg = "\nSyntax: k2ktrdump [-h] [-s] [-q] tracefile"
+"\n        -h       this help screen"
+"\n        -s       statistics only, no timeline"
+"\n        -q       timeline only, no statistics\n\n";
+
+static char data[TRACE_MAXDATA+8];
+struct trace_head h;
+struct trace_rec r;
+FILE    *fp;
+time_t  t;
+int     key, i, c, do_timeline = 1, do_stats = 1;
+int     last[MAXDEV];                       /* last command per device */
+unsigned long long tw[MAXDEV];              /* ... and its start */
+unsigned long n = 0, lost = 0;
+size_t  size;
+
+while ((key = getopt(argc, argv, "hsq")) != EOF)
+    switch (key)
+        {
+        case 'h':
+            fprintf (stderr, msg);
+            return 0;
+        case 's':
+            do_timeline = 0;
+            continue;
+        case 'q':
+            do_stats = 0;
+            continue;
+        default:
+            fprintf (stderr, "'%s -h' for help.\n\n", argv[0]);
+            return 1;
+        }
+
+if (argv[optind] == NULL)
+    {
+    fprintf (stderr, msg);
+    fprintf (stderr, "Please specify a trace file.\n");
+    return 1;
+    }
+
+if (NULL == (fp = fopen (argv[optind], "rb")))
+    {
+    fprintf(stderr, "Could not open '%s' for reading.\n", argv[optind]);
+    return ERR_FILE;
+    }
+if (1 != fread (&h, sizeof(h), 1, fp) || memcmp (h.magic, TRACE_MAGIC, 4))
+    {
+    fprintf(stderr, "'%s' is not a k2000 trace.\n", argv[optind]);
+    return ERR_FILE;
+    }
+if (h.endian != 0x1234 || h.version != TRACE_VERSION)
+    {
+    fprintf(stderr, "'%s': trace version %d from another machine type is not supported.\n",
+            argv[optind], h.version);
+    return ERR_FILE;
+    }
+
+t = (time_t)h.wall;
+printf("# Trace start: %s", ctime(&t));
+printf("# Responses %srecorded\n", (h.flags & TRACE_DATA) ? "" : "not ");
+if (do_timeline)
+    printf("#      time ms    dur us  op     dev   status   err     count  data\n");
+
+for (i = 0; i < MAXDEV; i++)
+    last[i] = -1;
+
+while (1 == fread (&r, sizeof(r), 1, fp))
+    {
+    size = (r.nbytes + 7) & ~7UL;
+    if (size > sizeof(data) || size != fread (data, 1, size, fp))
+        {
+        fprintf(stderr, "Trace is truncated after %lu records.\n", n);
+        break;
+        }
+    n++;
+
+    if (r.op == TR_LOST)
+        {
+        lost += r.arg;
+        for (i = 0; i < MAXDEV; i++)        /* cannot pair across a gap */
+            last[i] = -1;
+        if (do_timeline)
+            printf("%14.3f  --- %u records lost ---\n", (r.start - h.t0) / 1e6, r.arg);
+        continue;
+        }
+
+    if (do_timeline)
+        {
+        printf("%14.3f %9.1f  %-6s %3d  0x%04x %5d %9u ",
+               (r.start - h.t0) / 1e6, (r.end - r.start) / 1e3,
+               r.op < sizeof(opname)/sizeof(opname[0]) ? opname[r.op] : "?",
+               r.dev, r.sta, r.err, r.count);
+        if (r.op == TR_DEV || r.op == TR_TMO)
+            printf(" %u", r.arg);
+        if (r.op == TR_SPOLL)
+            printf(" 0x%02x", r.arg);
+        print_data (data, r.nbytes);
+        putchar ('\n');
+        }
+
+    if (r.op == TR_WRITE && (c = find_cmd (data, r.nbytes)) >= 0)
+        {
+        hist_add (&cmd[c].write, r.end - r.start);
+        if (r.err >= 0)
+            cmd[c].errors++;
+        last[r.dev] = c;
+        tw[r.dev] = r.start;
+        }
+    else if (r.op == TR_READ && (c = last[r.dev]) >= 0)
+        {
+        hist_add (&cmd[c].reply, r.end - tw[r.dev]);
+        if (r.err >= 0)
+            cmd[c].errors++;
+        last[r.dev] = -1;                   /* one reply per query */
+        }
+    }
+fclose (fp);
+
+if (do_stats)
+    {
+    printf("\n# %lu transactions", n);
+    if (lost)
+        printf(", %lu lost", lost);
+    printf("\n");
+    for (c = 0; c < ncmd; c++)
+        {
+        printf("\n# '%s'", cmd[c].text);
+        if (cmd[c].errors)
+            printf(" (%lu errors)", cmd[c].errors);
+        printf("\n");
+        hist_print (stdout, "#   ", "write", &cmd[c].write);
+        if (cmd[c].reply.count)
+            hist_print (stdout, "#   ", "write to reply", &cmd[c].reply);
+        }
+    }
+return 0;
+}
+
+
+/********************************************************
+* find_cmd: Looks up a command, adds it if new.         *
+* Input:    - command as written to the bus, and length *
+* Return:   index into cmd[], -1 if table is full       *
+********************************************************/
+static int find_cmd (const char *data, int len)
+{
+char    text[CMDLEN+1];
+int     i;
+
+while (len > 0 && (data[len-1] == '\n' || data[len-1] == '\r'))
+    len--;
+if (len > CMDLEN)
+    len = CMDLEN;
+memcpy (text, data, len);
+text[len] = 0;
+
+for (i = 0; i < ncmd; i++)
+    if (!strcmp (cmd[i].text, text))
+        return i;
+if (ncmd == MAXCMD)
+    return -1;
+strcpy (cmd[ncmd].text, text);
+hist_clear (&cmd[ncmd].write);
+hist_clear (&cmd[ncmd].reply);
+return ncmd++;
+}
+
+
+/* prints data quoted, control characters escaped, long data cut */
+static void print_data (const char *data, int len)
+{
+int     i;
+
+if (!len)
+    return;
+printf(" '");
+for (i = 0; i < len && i < 60; i++)
+    {
+    if (data[i] == '\n')
+        printf("\\n");
+    else if (data[i] == '\r')
+        printf("\\r");
+    else if ((unsigned char)data[i] < ' ' || (unsigned char)data[i] > '~')
+        printf("\\x%02x", (unsigned char)data[i]);
+    else
+        putchar (data[i]);
+    }
+printf(len > 60 ? "'..." : "'");
+}
@@ -0,0 +1,265 @@
+/* vi:set syntax=c expandtab tabstop=4 shiftwidth=4:
+
+ K 2 K W A T C H . C
+
+ Following a k2000 data file while it is being written.
+
+ Copyright (c) 2004...2026 by Joerg Hau.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 2 as
+ published by the Free Software Foundation, provided that the copyright
+ notice remains intact even in future versions. See the file LICENSE
+ for details
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ --------------------------------------------------------------------
+
+ k2000 writes its data file through stdio, so a reader may see half a
+ line between two flushes. These routines only ever return complete
+ lines: a line is handed out when its '\n' has arrived, and the byte
+ offset advances line by line. When there is nothing new, the caller
+ sleeps in poll() on an inotify descriptor and is woken by the next
+ write - no polling, and any number of readers can follow the same file.
+
+ To resume later, keep 'offset' and 'index' of the k2kfollow structure
+ and pass them to k2k_follow() again.
+
+ Linux only (inotify).
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "k2kfile.h"
+
+static int  peekline (struct k2kfollow *f, char *line, size_t *len);
+static void restart (struct k2kfollow *f, long long offset);
+static long long now_ms (void);
+
+
+/********************************************************
+* k2k_follow: Starts following a data file.             *
+* Input:    - pointer to follow structure               *
+*           - file name                                 *
+*           - byte offset to start at (0: beginning)    *
+*           - with offset 0: number of samples to skip; *
+*             otherwise: sample index at that offset    *
+* Return:   1 if OK, 0 if error                         *
+* Note:     The header is always read from the start.   *
+********************************************************/
+int k2k_follow (struct k2kfollow *f, const char *name, long long offset, long index)
+{
+struct k2krec r;
+char    line[K2K_MAXLEN+1];
+size_t  len;
+
+memset (f, 0, sizeof(*f));
+strncpy (f->info.name, name, K2K_MAXLEN);
+f->ino = -1;
+if ((f->fd = open (name, O_RDONLY)) < 0)
+    return 0;
+if ((f->ino = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+    inotify_add_watch (f->ino, name, IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+    {
+    k2k_unfollow (f);
+    return 0;
+    }
+
+/* --- header, as far as it is there already --- */
+
+while (peekline (f, line, &len) && (line[0] == '#' || !line[0]))
+    {
+    k2k_header (&f->info, line);
+    f->used += len;
+    f->offset += len;
+    }
+
+if (offset > 0)
+    {
+    restart (f, offset);
+    f->index = (index > 0) ? index : 0;
+    return 1;
+    }
+
+/* --- skip samples: just read them --- */
+
+while (index > 0 && k2k_follow_next (f, &r, 0) == 1)
+    index--;
+return 1;
+}
+
+
+/********************************************************
+* k2k_follow_next: Returns the next complete sample,    *
+*                  waiting for it if need be.           *
+* Input:    - pointer to follow structure               *
+*           - pointer to record to fill in              *
+*           - how long to wait, in ms (-1: forever),    *
+*             counted from the call; wake-ups without   *
+*             a complete sample do not restart it       *
+* Return:   1 if a record was read,                     *
+*           0 on timeout, or when a signal came in      *
+*             (the caller checks its flags, then calls  *
+*             again)                                    *
+*          -1 at the end: "Acquisition stop" was read,  *
+*             or the file was removed or renamed        *
+* Note:     If the file gets shorter (overwritten by a  *
+*           new run), it is followed from the start.    *
+********************************************************/
+int k2k_follow_next (struct k2kfollow *f, struct k2krec *r, int timeout)
+{
+char    line[K2K_MAXLEN+1];
+char    ev[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+const struct inotify_event *e;
+struct pollfd pfd;
+struct stat st;
+size_t  len;
+ssize_t n;
+char    *p;
+long long end = (timeout < 0) ? 0 : now_ms () + timeout, left = -1;
+
+for (;;)
+    {
+    while (peekline (f, line, &len))
+        {
+        f->used += len;
+        f->offset += len;
+        if (line[0] == '#')
+            {
+            k2k_header (&f->info, line);
+            if (!strncmp (line, "# Acquisition stop", 18))
+                f->ended = 1;
+            continue;
+            }
+        if (k2k_parse (line, r))
+            {
+            f->index++;
+            return 1;
+            }
+        }
+    if (f->ended)
+        return -1;
+
+    /* --- nothing new: overwritten? --- */
+    if (!fstat (f->fd, &st) && st.st_size < f->offset + (long long)(f->have - f->used))
+        {
+        strcpy (line, f->info.name);
+        memset (&f->info, 0, sizeof(f->info));
+        strcpy (f->info.name, line);
+        f->ended = 0;
+        f->index = 0;
+        restart (f, 0);
+        continue;
+        }
+
+    /* --- wait for the writer --- */
+    if (timeout >= 0 && (left = end - now_ms ()) < 0)
+        left = 0;
+    pfd.fd = f->ino;
+    pfd.events = POLLIN;
+    if ((n = poll (&pfd, 1, (int)left)) == 0 || (n < 0 && errno == EINTR))
+        return 0;
+    if (n < 0)
+        return -1;
+    while ((n = read (f->ino, ev, sizeof(ev))) > 0)
+        for (p = ev; p < ev + n; p += sizeof(*e) + e->len)
+            {
+            e = (const struct inotify_event *)p;
+            if (e->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                f->ended = 1;
+            }
+    }
+}
+
+
+/********************************************************
+* k2k_unfollow: Stops following a file.                 *
+* Input:    - pointer to follow structure               *
+* Return:   Nothing.                                    *
+********************************************************/
+void k2k_unfollow (struct k2kfollow *f)
+{
+if (f->fd >= 0)
+    close (f->fd);
+if (f->ino >= 0)
+    close (f->ino);
+f->fd = f->ino = -1;
+}
+
+
+/* a monotonic clock, in ms */
+static long long now_ms (void)
+{
+struct timespec ts;
+
+clock_gettime (CLOCK_MONOTONIC, &ts);
+return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+
+/* starts reading afresh at a byte offset */
+static void restart (struct k2kfollow *f, long long offset)
+{
+f->offset = offset;
+f->have = f->used = 0;
+lseek (f->fd, (off_t)offset, SEEK_SET);
+}
+
+/********************************************************
+* peekline: Looks for the next complete line, without   *
+*           consuming it.                               *
+* Input:    - pointer to follow structure               *
+*           - buffer for line (without CR/LF)           *
+*           - where to store its length in the file     *
+* Return:   1 if a complete line is there, 0 if not     *
+* Note:     Overlong lines are cut.                     *
+********************************************************/
+static int peekline (struct k2kfollow *f, char *line, size_t *len)
+{
+char    *nl;
+size_t  n;
+ssize_t got;
+
+for (;;)
+    {
+    nl = memchr (f->buf + f->used, '\n', f->have - f->used);
+    if (nl)
+        {
+        *len = nl - (f->buf + f->used) + 1;
+        n = (*len - 1 > K2K_MAXLEN) ? K2K_MAXLEN : *len - 1;
+        memcpy (line, f->buf + f->used, n);
+        line[n] = 0;
+        line[strcspn (line, "\r")] = 0;
+        return 1;
+        }
+
+    if (f->used > 0)            /* make room */
+        {
+        memmove (f->buf, f->buf + f->used, f->have - f->used);
+        f->have -= f->used;
+        f->used = 0;
+        }
+    if (f->have == sizeof(f->buf))  /* no '\n' in 64 kB: not our file */
+        {
+        f->offset += f->have;
+        f->have = 0;
+        }
+    got = read (f->fd, f->buf + f->have, sizeof(f->buf) - f->have);
+    if (got <= 0)
+        return 0;
+    f->have += got;
+    }
+}